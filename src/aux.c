@@ -12,3 +12,17 @@ struct point dilateAbout(struct point pivot, struct point org, float scale) {
   return (struct point){.x=pivot.x - (pivot.x-org.x) * scale, .y=pivot.y - (pivot.y - org.y) * scale};  
 }
 
+
+int64_t timespecToNs(const struct timespec *ts) {
+  return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+struct timespec nsToTimespec(int64_t ns) {
+  return (struct timespec){ .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+}
+
+int64_t monotonicNs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return timespecToNs(&now);
+}
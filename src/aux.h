@@ -1,4 +1,6 @@
 #pragma once
+#include <stdint.h>
+#include <time.h>
 
 struct point {
   float x, y;
@@ -9,3 +11,8 @@ struct point {
 // Rotate a point about a pivot given radian amount.
 struct point rotateAbout(struct point, struct point, float);
 struct point dilateAbout(struct point, struct point, float);
+
+// Nanoseconds on CLOCK_MONOTONIC, and conversions to and from timespec.
+int64_t monotonicNs(void);
+int64_t timespecToNs(const struct timespec *);
+struct timespec nsToTimespec(int64_t);
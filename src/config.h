@@ -5,3 +5,66 @@
 #define CURSOR_FRAGMENT_SHADER (const char*)"./src/shader/cursor_frag.glsl"
 #define DEBUG_VERTEX_SHADER (const char*)"./src/shader/debug_vert.glsl"
 #define DEBUG_FRAGMENT_SHADER (const char*)"./src/shader/debug_frag.glsl"
+#define HEATMAP_FRAGMENT_SHADER (const char*)"./src/shader/heat_frag.glsl"
+
+// Surfaces whose opaque/translucent split needs more quads than this are drawn as one blended quad
+#define MAX_SPLIT_RECTS 16
+
+// Frames of damage kept per output; older buffers are repainted in full
+#define DAMAGE_HISTORY 4
+
+// Height of the horizontal bands approximating a rotated view's damage region
+#define SCENE_BAND_HEIGHT 16
+
+// Lens cursor radius in pixels; it samples the scene up to three radii from its center
+#define CURSOR_LENS_RADIUS 14
+
+// Starting per-frame cost estimates for damage simplification, refined by GPU timing
+#define DAMAGE_RECT_COST_US 20.0
+#define DAMAGE_MPIXEL_COST_US 500.0
+
+// Damage regions with more rects than this are only weighed against their extents and full output
+#define DAMAGE_MERGE_MAX_RECTS 64
+
+// Frames of damage the debug overlay keeps on screen, fading out with age
+#define DEBUG_DAMAGE_FRAMES 30
+
+// View springs: stiffness in 1/s^2, integrated at a fixed rate whatever the refresh rate
+#define ANIMATION_STIFFNESS 620.0f
+#define ANIMATION_STEP_HZ 240
+// Longest stretch of time caught up in one frame, in seconds, after a stall
+#define ANIMATION_MAX_LAG 0.1
+// Views closer than this to their target, moving slower than this, snap and settle
+#define ANIMATION_SNAP_DISTANCE 0.5f
+#define ANIMATION_SETTLE_VELOCITY 6.0f
+#define ANIMATION_SNAP_ANGLE 0.01f
+#define ANIMATION_SETTLE_ROT_VELOCITY 0.06f
+// Seconds a newly created view keeps being repainted as it fades in
+#define ANIMATION_FADE_IN 0.16f
+
+// Frames whose render times predict the next one's; the prediction is their maximum
+#define RENDER_TIME_HISTORY 32
+// Render time assumed for a new output until it has measurements, in microseconds
+#define RENDER_TIME_INITIAL_US 6000
+// Slack left between the predicted end of rendering and the vblank, in microseconds
+#define RENDER_SAFETY_MARGIN_US 1500
+
+// Frame callbacks per second for views that are covered or on no output
+#define FRAME_THROTTLE_HZ 4
+
+// Seconds between periodic input-to-photon latency logs of each output
+#define LATENCY_LOG_INTERVAL 30
+// A focused view's damage only counts as its response to a key this many milliseconds after it
+#define KEY_RESPONSE_WINDOW_MS 500
+
+// Realtime mode (-r): SCHED_RR priority, or the nice value tried when that is refused
+#define REALTIME_PRIORITY 20
+#define REALTIME_NICE -10
+// Period of the jitter probe (-j) timer, in milliseconds
+#define JITTER_PERIOD_MS 10
+
+// Longest a pass of the event loop spends dispatching client requests before
+// going on to render, in microseconds; the rest waits for the next pass
+#define CLIENT_DISPATCH_BUDGET_US 2000
+// Most epoll batches of backend events handled in one go
+#define INPUT_DRAIN_ROUNDS 8
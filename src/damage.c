@@ -0,0 +1,244 @@
+#include "damage.h"
+#include "config.h"
+#include <math.h>
+#include <string.h>
+
+/* Weight a sample loses per frame, so the fit follows load changes */
+#define COST_DECAY 0.98
+/* Pull of the prior on the fit, in samples' worth */
+#define COST_PRIOR_WEIGHT 4.0
+
+void initDamageCostModel(struct damageCostModel *model) {
+  memset(model, 0, sizeof(*model));
+  model->fixedUs = 0;
+  model->rectUs = DAMAGE_RECT_COST_US;
+  model->mpixelUs = DAMAGE_MPIXEL_COST_US;
+
+  const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+  model->timerQueries = extensions && strstr(extensions, "GL_EXT_disjoint_timer_query");
+  if (model->timerQueries) {
+    glGenQueries(DAMAGE_TIMER_QUERIES, model->queries);
+  }
+  LOG("Damage cost model: %s", model->timerQueries ? "GPU timed" : "fixed estimate");
+}
+
+void finishDamageCostModel(struct damageCostModel *model) {
+  if (model->timerQueries) {
+    glDeleteQueries(DAMAGE_TIMER_QUERIES, model->queries);
+    model->timerQueries = false;
+  }
+}
+
+static double regionMpixels(pixman_region32_t *region) {
+  int num_rects = 0;
+  pixman_box32_t *rects = pixman_region32_rectangles(region, &num_rects);
+  double pixels = 0;
+  for (int i = 0; i < num_rects; i++) {
+    pixels += (double)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+  }
+  return pixels / 1e6;
+}
+
+static double boxArea(pixman_box32_t *b) {
+  return (double)(b->x2 - b->x1) * (b->y2 - b->y1);
+}
+
+static double frameCost(struct damageCostModel *model, int rects, double mpixels) {
+  return model->rectUs * rects + model->mpixelUs * mpixels;
+}
+
+/* Replace the damage with the cheapest of its raw rects, a greedy merge of
+ * them into fewer bounding boxes, or the whole output. Every candidate
+ * covers the original damage. */
+enum damageStrategy simplifyDamage(struct damageCostModel *model, pixman_region32_t *damage,
+                                   int width, int height) {
+  int num_rects = 0;
+  pixman_box32_t *rects = pixman_region32_rectangles(damage, &num_rects);
+  if (num_rects <= 1) {
+    return DAMAGE_RAW;
+  }
+
+  enum damageStrategy strategy = DAMAGE_RAW;
+  double best = frameCost(model, num_rects, regionMpixels(damage));
+
+  double full = frameCost(model, 1, (double)width * height / 1e6);
+  if (full < best) {
+    best = full;
+    strategy = DAMAGE_FULL;
+  }
+
+  /* Merge the pair whose bounding box adds the least area, one step at a
+   * time, keeping the cheapest set seen. Large regions only get to try
+   * their extents. */
+  pixman_box32_t boxes[DAMAGE_MERGE_MAX_RECTS];
+  pixman_box32_t bestBoxes[DAMAGE_MERGE_MAX_RECTS];
+  int count, bestCount = 0;
+  if (num_rects <= DAMAGE_MERGE_MAX_RECTS) {
+    count = num_rects;
+    memcpy(boxes, rects, sizeof(pixman_box32_t) * count);
+  } else {
+    count = 1;
+    boxes[0] = *pixman_region32_extents(damage);
+  }
+
+  double area = 0;
+  for (int i = 0; i < count; i++) {
+    area += boxArea(&boxes[i]);
+  }
+  while (count >= 1) {
+    if (count < num_rects) {
+      double cost = frameCost(model, count, area / 1e6);
+      if (cost < best) {
+        best = cost;
+        strategy = DAMAGE_MERGED;
+        bestCount = count;
+        memcpy(bestBoxes, boxes, sizeof(pixman_box32_t) * count);
+      }
+    }
+    if (count == 1) {
+      break;
+    }
+
+    int mi = 0, mj = 1;
+    double growth = INFINITY;
+    for (int i = 0; i < count; i++) {
+      for (int j = i + 1; j < count; j++) {
+        pixman_box32_t u = {
+          boxes[i].x1 < boxes[j].x1 ? boxes[i].x1 : boxes[j].x1,
+          boxes[i].y1 < boxes[j].y1 ? boxes[i].y1 : boxes[j].y1,
+          boxes[i].x2 > boxes[j].x2 ? boxes[i].x2 : boxes[j].x2,
+          boxes[i].y2 > boxes[j].y2 ? boxes[i].y2 : boxes[j].y2,
+        };
+        double g = boxArea(&u) - boxArea(&boxes[i]) - boxArea(&boxes[j]);
+        if (g < growth) {
+          growth = g;
+          mi = i;
+          mj = j;
+        }
+      }
+    }
+    area += growth;
+    boxes[mi].x1 = boxes[mi].x1 < boxes[mj].x1 ? boxes[mi].x1 : boxes[mj].x1;
+    boxes[mi].y1 = boxes[mi].y1 < boxes[mj].y1 ? boxes[mi].y1 : boxes[mj].y1;
+    boxes[mi].x2 = boxes[mi].x2 > boxes[mj].x2 ? boxes[mi].x2 : boxes[mj].x2;
+    boxes[mi].y2 = boxes[mi].y2 > boxes[mj].y2 ? boxes[mi].y2 : boxes[mj].y2;
+    boxes[mj] = boxes[--count];
+  }
+
+  if (strategy == DAMAGE_FULL) {
+    pixman_region32_fini(damage);
+    pixman_region32_init_rect(damage, 0, 0, width, height);
+  } else if (strategy == DAMAGE_MERGED) {
+    pixman_region32_fini(damage);
+    pixman_region32_init_rects(damage, bestBoxes, bestCount);
+  }
+  return strategy;
+}
+
+/* Solve (normal + prior) * theta = rhs + prior * theta0 for the three
+ * cost terms by Cramer's rule */
+static void fitCostModel(struct damageCostModel *model) {
+  double theta0[3] = { 0.0, DAMAGE_RECT_COST_US, DAMAGE_MPIXEL_COST_US };
+  double a[3][3], b[3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      a[i][j] = model->normal[i][j] + (i == j ? COST_PRIOR_WEIGHT : 0);
+    }
+    b[i] = model->rhs[i] + COST_PRIOR_WEIGHT * theta0[i];
+  }
+
+  double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+             - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+             + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+  if (fabs(det) < 1e-9) {
+    return;
+  }
+
+  double theta[3];
+  for (int k = 0; k < 3; k++) {
+    double m[3][3];
+    memcpy(m, a, sizeof(m));
+    for (int i = 0; i < 3; i++) {
+      m[i][k] = b[i];
+    }
+    theta[k] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+              - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+              + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / det;
+  }
+
+  /* Costs can't be negative; noise early on can make them so */
+  model->fixedUs = fmax(theta[0], 0);
+  model->rectUs = fmax(theta[1], 0.1);
+  model->mpixelUs = fmax(theta[2], 1.0);
+}
+
+static void addCostSample(struct damageCostModel *model, int rects, double mpixels, double us) {
+  double x[3] = { 1.0, rects, mpixels };
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      model->normal[i][j] = model->normal[i][j] * COST_DECAY + x[i] * x[j];
+    }
+    model->rhs[i] = model->rhs[i] * COST_DECAY + x[i] * us;
+  }
+  model->samples++;
+  fitCostModel(model);
+}
+
+/* Harvest finished queries without ever waiting on the GPU */
+static void collectDamageTiming(struct damageCostModel *model) {
+  GLint disjoint = 0;
+  glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+  for (int i = 0; i < DAMAGE_TIMER_QUERIES; i++) {
+    if (!model->inflight[i].pending) {
+      continue;
+    }
+    GLuint available = 0;
+    glGetQueryObjectuiv(model->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      continue;
+    }
+    GLuint ns = 0;
+    glGetQueryObjectuiv(model->queries[i], GL_QUERY_RESULT, &ns);
+    model->inflight[i].pending = false;
+    if (!disjoint) {
+      addCostSample(model, model->inflight[i].rects, model->inflight[i].mpixels, ns / 1000.0);
+    }
+  }
+}
+
+void beginDamageTiming(struct damageCostModel *model, pixman_region32_t *damage) {
+  if (!model->timerQueries) {
+    return;
+  }
+  collectDamageTiming(model);
+
+  /* Every query still in flight: skip timing this frame */
+  int slot = model->queryHead;
+  if (model->inflight[slot].pending) {
+    return;
+  }
+  model->inflight[slot].rects = pixman_region32_n_rects(damage);
+  model->inflight[slot].mpixels = regionMpixels(damage);
+  glBeginQuery(GL_TIME_ELAPSED_EXT, model->queries[slot]);
+  model->timing = true;
+}
+
+void endDamageTiming(struct damageCostModel *model) {
+  if (!model->timing) {
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED_EXT);
+  model->inflight[model->queryHead].pending = true;
+  model->queryHead = (model->queryHead + 1) % DAMAGE_TIMER_QUERIES;
+  model->timing = false;
+}
+
+const char *damageStrategyName(enum damageStrategy strategy) {
+  switch (strategy) {
+  case DAMAGE_RAW: return "raw";
+  case DAMAGE_MERGED: return "merged";
+  case DAMAGE_FULL: return "full";
+  }
+  return "?";
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "imports.h"
+
+/* How a frame's damage was reshaped before rendering */
+enum damageStrategy {
+  DAMAGE_RAW,      // the region's own rects
+  DAMAGE_MERGED,   // rects greedily merged into fewer bounding boxes
+  DAMAGE_FULL,     // the whole output
+};
+
+#define DAMAGE_TIMER_QUERIES 3
+
+/*
+  Per-output estimate of what a frame costs: a fixed part, a price per
+  damage rect (stencil clears, cache blits, state changes) and a price per
+  megapixel filled, fitted from GPU timer queries when the driver has them
+ */
+struct damageCostModel {
+  double fixedUs, rectUs, mpixelUs;
+  double normal[3][3];     // exponentially decayed normal equations
+  double rhs[3];
+  int samples;
+
+  bool timerQueries;
+  GLuint queries[DAMAGE_TIMER_QUERIES];
+  struct {
+    bool pending;
+    int rects;
+    double mpixels;
+  } inflight[DAMAGE_TIMER_QUERIES];
+  int queryHead;
+  bool timing;
+};
+
+void initDamageCostModel(struct damageCostModel *);
+void finishDamageCostModel(struct damageCostModel *);
+enum damageStrategy simplifyDamage(struct damageCostModel *, pixman_region32_t *damage,
+                                   int width, int height);
+void beginDamageTiming(struct damageCostModel *, pixman_region32_t *damage);
+void endDamageTiming(struct damageCostModel *);
+const char *damageStrategyName(enum damageStrategy);
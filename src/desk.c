@@ -1,9 +1,50 @@
+#define _GNU_SOURCE
 #include "server.h"
 #include "shader.h"
 #include "events.h"
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+
+static void usage(const char *name) {
+  printf("Usage: %s [-r] [-c cpu] [-j]\n"
+         "  -r      run the event loop SCHED_RR (or at a raised nice value) with memory locked\n"
+         "  -c cpu  pin the event loop to a CPU\n"
+         "  -j      measure timer wakeup lateness, logged with the latency histograms\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  struct realtimeOptions realtime = { .enabled = false, .cpu = -1, .jitter = false };
+  int opt;
+  while ((opt = getopt(argc, argv, "rc:jh")) != -1) {
+    switch (opt) {
+    case 'r':
+      realtime.enabled = true;
+      break;
+    case 'c': {
+      char *end;
+      errno = 0;
+      long cpu = strtol(optarg, &end, 10);
+      if (errno || end == optarg || *end != '\0' || cpu < 0 || cpu >= CPU_SETSIZE) {
+        fprintf(stderr, "%s: invalid CPU '%s'\n", argv[0], optarg);
+        usage(argv[0]);
+        return 1;
+      }
+      realtime.cpu = cpu;
+      break;
+    }
+    case 'j':
+      realtime.jitter = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 1;
+    }
+  }
 
-int main() {
   struct DeskServer *server = newServer();
+  server->realtime = realtime;
   startServer(server);
 
   return 0;
@@ -0,0 +1,81 @@
+#include "histogram.h"
+#include "macro.h"
+#include <string.h>
+
+void histogramReset(struct histogram *hist) {
+  memset(hist, 0, sizeof(*hist));
+}
+
+static int bucketIndex(uint64_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  int exponent = 63 - __builtin_clzll(value);
+  if (exponent > 31) {
+    return HISTOGRAM_BUCKETS - 1;
+  }
+  int sub = (value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1);
+  return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/* Smallest value that lands in a bucket, and the bucket's width */
+static uint64_t bucketLow(int index, uint64_t *width) {
+  if (index < HISTOGRAM_SUB_BUCKETS) {
+    *width = 1;
+    return index;
+  }
+  int exponent = index / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+  int sub = index % HISTOGRAM_SUB_BUCKETS;
+  *width = 1ull << (exponent - HISTOGRAM_SUB_BITS);
+  return (1ull << exponent) + sub * *width;
+}
+
+void histogramAdd(struct histogram *hist, int64_t value) {
+  if (value < 0) {
+    value = 0;
+  }
+  if (hist->count == 0 || value < hist->min) {
+    hist->min = value;
+  }
+  if (hist->count == 0 || value > hist->max) {
+    hist->max = value;
+  }
+  hist->buckets[bucketIndex(value)]++;
+  hist->count++;
+  hist->sum += value;
+}
+
+int64_t histogramPercentile(const struct histogram *hist, double p) {
+  if (hist->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * hist->count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= rank) {
+      /* Middle of the bucket, kept within what was actually seen */
+      uint64_t width;
+      int64_t value = bucketLow(i, &width) + width / 2;
+      if (value < hist->min) value = hist->min;
+      if (value > hist->max) value = hist->max;
+      return value;
+    }
+  }
+  return hist->max;
+}
+
+void histogramLog(const struct histogram *hist, const char *label) {
+  if (hist->count == 0) {
+    LOG("%s: no samples", label);
+    return;
+  }
+  LOG("%s: n=%llu mean %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f ms", label,
+      (unsigned long long)hist->count, (double)hist->sum / hist->count / 1e3,
+      histogramPercentile(hist, 0.50) / 1e3, histogramPercentile(hist, 0.95) / 1e3,
+      histogramPercentile(hist, 0.99) / 1e3, hist->max / 1e3);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+/* Sixteen linear buckets per power of two, so any value is within about
+ * 6% of its bucket's bounds, from one up to 2^32 */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/* Log-linear histogram of non-negative integer samples */
+struct histogram {
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  int64_t min, max;
+};
+
+void histogramReset(struct histogram *);
+void histogramAdd(struct histogram *, int64_t value);
+// Value below which a fraction p of the samples fall, 0 when empty
+int64_t histogramPercentile(const struct histogram *, double p);
+// One line of count, p50/p95/p99 and max, samples taken as microseconds
+void histogramLog(const struct histogram *, const char *label);
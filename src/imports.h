@@ -26,7 +26,12 @@
 #include <wlr/render/wlr_texture.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/types/wlr_layer_shell_v1.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
+#include <wlr/types/wlr_content_type_v1.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
+#include <wlr/util/transform.h>
 #include <wlr/render/egl.h>
 #include <wlr/render/gles2.h>
 #include <xkbcommon/xkbcommon.h>
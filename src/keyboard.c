@@ -14,6 +14,11 @@ static void spawn_wayland_client(struct DeskServer *server, const char *cmd) {
 
   if (pid == 0) {
     // Child process - client connects via WAYLAND_DISPLAY (inherited from parent)
+    leaveRealtime();
+    // The event loop blocks the signals it reads through a signalfd; don't pass that on
+    sigset_t set;
+    sigemptyset(&set);
+    sigprocmask(SIG_SETMASK, &set, NULL);
     execl("/bin/sh", "/bin/sh", "-c", cmd, (char *)NULL);
     wlr_log_errno(WLR_ERROR, "exec failed");
     exit(1);
@@ -39,7 +44,22 @@ HANDLE(modifiers, void, Keyboard){
     container->server->grabbed_view = NULL;
   }
 }
+// Shift, Control, Alt, Super and the like: the client has nothing to draw for them
+static bool modifierOnly(const xkb_keysym_t *syms, int nsyms) {
+  for (int i = 0; i < nsyms; i++) {
+    bool modifier = (syms[i] >= XKB_KEY_Shift_L && syms[i] <= XKB_KEY_Hyper_R) ||
+      syms[i] == XKB_KEY_ISO_Level3_Shift || syms[i] == XKB_KEY_ISO_Level5_Shift ||
+      syms[i] == XKB_KEY_Mode_switch || syms[i] == XKB_KEY_Num_Lock;
+    if (!modifier) {
+      return false;
+    }
+  }
+  return true;
+}
+
 HANDLE(key, struct wlr_keyboard_key_event, Keyboard){
+  int64_t arrived = monotonicNs();
+  noteInputQueueing(&container->server->loop, data->time_msec);
   wlr_seat_set_keyboard(container->server->seat, container->wlr_keyboard);
   wlr_seat_keyboard_notify_key(container->server->seat, data->time_msec,
 			       data->keycode, data->state);
@@ -57,7 +77,7 @@ HANDLE(key, struct wlr_keyboard_key_event, Keyboard){
   for(int i = 0; i < nsyms; i++) {
     if(syms[i] == XKB_KEY_Escape && altPressed) {
       wl_display_destroy_clients(container->server->display);
-      wl_display_terminate(container->server->display);
+      stopServer(container->server);
       return;
     }
     if(syms[i] == XKB_KEY_q && altPressed) {
@@ -107,6 +127,22 @@ HANDLE(key, struct wlr_keyboard_key_event, Keyboard){
       damageWholeServer(container->server);
       return;
     }
+
+    if(syms[i] == XKB_KEY_p && altPressed && data->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+      dumpLatency(container->server);
+      return;
+    }
+
+    if(syms[i] == XKB_KEY_l && altPressed && data->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+      setLensCursor(container->server, !container->server->lensCursor);
+      LOG("Lens cursor: %s", container->server->lensCursor ? "ON" : "OFF");
+      return;
+    }
+  }
+
+  /* A press no shortcut took; the focused client may draw a response */
+  if (data->state == WL_KEYBOARD_KEY_STATE_PRESSED && !modifierOnly(syms, nsyms)) {
+    noteKeyInput(container->server, arrived);
   }
 }
 HANDLE(destroy, void, Keyboard){
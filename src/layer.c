@@ -7,11 +7,7 @@ static void damageLayerSurface(struct LayerSurface *ls) {
     return;
   }
 
-  struct wlr_box box;
-  wlr_surface_get_extents(ls->layer_surface->surface, &box);
-  box.x += ls->x;
-  box.y += ls->y;
-
+  struct wlr_box box = layerNode(ls)->bounds;
   damageOutputBox(ls->output, &box);
 }
 
@@ -24,6 +20,7 @@ struct LayerSurface *mkLayerSurface(struct DeskServer *server,
   layer_surface->layer_surface = wlr_layer_surface;
   layer_surface->mapped = false;
   layer_surface->layer = wlr_layer_surface->pending.layer;
+  initSceneNode(&layer_surface->node, SCENE_NODE_LAYER);
 
   struct Output *output = NULL;
   if (wlr_layer_surface->output) {
@@ -41,12 +38,14 @@ struct LayerSurface *mkLayerSurface(struct DeskServer *server,
 
   if (!output) {
     wlr_layer_surface_v1_destroy(wlr_layer_surface);
+    finishSceneNode(&layer_surface->node);
     free(layer_surface);
     return NULL;
   }
 
   layer_surface->output = output;
   wlr_layer_surface->data = layer_surface;
+  setSurfaceOwner(server, wlr_layer_surface->surface, SURFACE_OWNER_LAYER, layer_surface);
 
   ATTACH(LayerSurface, layer_surface, wlr_layer_surface->surface->events.map, map);
   ATTACH(LayerSurface, layer_surface, wlr_layer_surface->surface->events.unmap, unmap);
@@ -62,12 +61,15 @@ struct LayerSurface *mkLayerSurface(struct DeskServer *server,
 void destroyLayerSurface(struct LayerSurface *layer_surface) {
   if (!layer_surface) return;
 
+  setSurfaceOwner(layer_surface->server, layer_surface->layer_surface->surface,
+                  SURFACE_OWNER_NONE, NULL);
   wl_list_remove(&layer_surface->map.link);
   wl_list_remove(&layer_surface->unmap.link);
   wl_list_remove(&layer_surface->destroy.link);
   wl_list_remove(&layer_surface->commit.link);
   wl_list_remove(&layer_surface->new_popup.link);
   wl_list_remove(&layer_surface->link);
+  finishSceneNode(&layer_surface->node);
 
   free(layer_surface);
 }
@@ -75,15 +77,13 @@ void destroyLayerSurface(struct LayerSurface *layer_surface) {
 void arrangeLayerSurfaces(struct Output *output) {
   if (!output || !output->wlr_output) return;
 
-  int output_width = output->wlr_output->width;
-  int output_height = output->wlr_output->height;
-
-  struct wlr_box usable_area = {
-    .x = 0,
-    .y = 0,
-    .width = output_width,
-    .height = output_height,
-  };
+  /* Layer surfaces are placed in layout coordinates, within the output's
+   * logical box */
+  struct wlr_box usable_area;
+  wlr_output_layout_get_box(output->server->outputLayout, output->wlr_output, &usable_area);
+  if (wlr_box_empty(&usable_area)) {
+    return;
+  }
 
   for (int layer_idx = 0; layer_idx < 4; layer_idx++) {
     struct LayerSurface *ls;
@@ -141,6 +141,7 @@ void arrangeLayerSurfaces(struct Output *output) {
 
       ls->x = x;
       ls->y = y;
+      ls->node.dirty = true;
 
       if (state->exclusive_zone > 0) {
         if (state->anchor & ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP &&
@@ -170,6 +171,7 @@ void arrangeLayerSurfaces(struct Output *output) {
 HANDLE(map, void, LayerSurface) {
   LOG("Layer surface mapped");
   container->mapped = true;
+  container->node.dirty = true;
   
   struct wlr_layer_surface_v1_state *state = &container->layer_surface->current;
   if (state->keyboard_interactive) {
@@ -183,6 +185,7 @@ HANDLE(unmap, void, LayerSurface) {
   LOG("Layer surface unmapped");
   damageLayerSurface(container);
   container->mapped = false;
+  container->node.dirty = true;
   
   struct Output *output = container->output;
   if (output) {
@@ -215,6 +218,7 @@ HANDLE(commit, struct wlr_surface, LayerSurface) {
     wl_list_insert(&container->output->layers[layer], &container->link);
   }
 
+  container->node.dirty = true;
   arrangeLayerSurfaces(container->output);
   damageLayerSurface(container);
 }
@@ -250,8 +254,8 @@ struct LayerSurface *layerSurfaceAt(struct DeskServer *server, double lx, double
           continue;
         }
 
-        double local_x = lx - ls->x;
-        double local_y = ly - ls->y;
+        double local_x, local_y;
+        sceneNodeToLocal(layerNode(ls), lx, ly, &local_x, &local_y);
 
         double _sx, _sy;
         struct wlr_surface *_surface = wlr_layer_surface_v1_surface_at(
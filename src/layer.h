@@ -1,6 +1,7 @@
 #pragma once
 #include "imports.h"
 #include "events.h"
+#include "scene.h"
 
 struct DeskServer;
 struct Output;
@@ -20,6 +21,8 @@ typedef struct LayerSurface {
   bool mapped;
   int x, y;
   uint32_t layer;
+
+  struct SceneNode node;
 } LayerSurface;
 
 struct LayerSurface *mkLayerSurface(struct DeskServer *server, 
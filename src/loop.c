@@ -0,0 +1,111 @@
+#include "loop.h"
+#include "server.h"
+#include "config.h"
+#include <errno.h>
+#include <poll.h>
+
+void initEventLoop(struct eventLoop *loop, struct wl_display *display) {
+  ASSERTN(loop->backend = wl_event_loop_create());
+  loop->clients = wl_display_get_event_loop(display);
+  loop->running = false;
+  loop->clientsReadyNs = 0;
+  histogramReset(&loop->inputQueue);
+  histogramReset(&loop->clientQueue);
+  histogramReset(&loop->renderQueue);
+  loop->lastLogNs = monotonicNs();
+}
+
+void finishEventLoop(struct eventLoop *loop) {
+  wl_event_loop_destroy(loop->backend);
+}
+
+static bool loopReady(struct wl_event_loop *loop) {
+  struct pollfd pfd = { .fd = wl_event_loop_get_fd(loop), .events = POLLIN };
+  return poll(&pfd, 1, 0) > 0;
+}
+
+/* Everything the backend has ready, a bounded number of rounds so a
+ * flood of input cannot starve clients outright */
+static void drainBackend(struct eventLoop *loop) {
+  wl_event_loop_dispatch_idle(loop->backend);
+  for (int i = 0; i < INPUT_DRAIN_ROUNDS && loopReady(loop->backend); i++) {
+    wl_event_loop_dispatch(loop->backend, 0);
+  }
+}
+
+/* Client requests in rounds of one epoll batch, going back to the backend
+ * between rounds, until nothing is waiting or the budget is spent. A
+ * single client's burst within a round cannot be split. */
+static void dispatchClients(struct eventLoop *loop) {
+  int64_t start = monotonicNs();
+  if (loop->clientsReadyNs) {
+    histogramAdd(&loop->clientQueue, (start - loop->clientsReadyNs) / 1000);
+    loop->clientsReadyNs = 0;
+  }
+
+  do {
+    wl_event_loop_dispatch(loop->clients, 0);
+    drainBackend(loop);
+  } while (monotonicNs() - start < (int64_t)CLIENT_DISPATCH_BUDGET_US * 1000 &&
+           loopReady(loop->clients));
+
+  if (loopReady(loop->clients)) {
+    loop->clientsReadyNs = monotonicNs();
+  }
+}
+
+static void logPeriodically(struct eventLoop *loop) {
+  int64_t now = monotonicNs();
+  if (now - loop->lastLogNs < (int64_t)LATENCY_LOG_INTERVAL * 1000000000) {
+    return;
+  }
+  logEventLoop(loop);
+  histogramReset(&loop->inputQueue);
+  histogramReset(&loop->clientQueue);
+  histogramReset(&loop->renderQueue);
+  loop->lastLogNs = now;
+}
+
+/* Stands in for wl_display_run. Per pass: backend, clients within their
+ * budget, backend again, then the outputs whose frames came in. */
+void runEventLoop(struct DeskServer *server) {
+  struct eventLoop *loop = &server->loop;
+  struct pollfd fds[2] = {
+    { .fd = wl_event_loop_get_fd(loop->backend), .events = POLLIN },
+    { .fd = wl_event_loop_get_fd(loop->clients), .events = POLLIN },
+  };
+
+  loop->running = true;
+  while (loop->running) {
+    /* Idle sources do not wake poll; run any added since the last pass */
+    wl_event_loop_dispatch_idle(loop->clients);
+    wl_event_loop_dispatch_idle(loop->backend);
+    wl_display_flush_clients(server->display);
+
+    if (poll(fds, 2, outputsQueued(server) ? 0 : -1) < 0 && errno != EINTR) {
+      wlr_log_errno(WLR_ERROR, "poll failed");
+      break;
+    }
+    if ((fds[1].revents & POLLIN) && !loop->clientsReadyNs) {
+      loop->clientsReadyNs = monotonicNs();
+    }
+
+    drainBackend(loop);
+    if (loop->clientsReadyNs) {
+      dispatchClients(loop);
+    }
+    renderQueuedOutputs(server);
+    logPeriodically(loop);
+  }
+}
+
+void noteInputQueueing(struct eventLoop *loop, uint32_t time_msec) {
+  uint32_t nowMs = monotonicNs() / 1000000;
+  histogramAdd(&loop->inputQueue, (int64_t)(uint32_t)(nowMs - time_msec) * 1000);
+}
+
+void logEventLoop(struct eventLoop *loop) {
+  histogramLog(&loop->inputQueue, "Input queueing");
+  histogramLog(&loop->clientQueue, "Client queueing");
+  histogramLog(&loop->renderQueue, "Frame queueing");
+}
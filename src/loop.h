@@ -0,0 +1,33 @@
+#pragma once
+#include "imports.h"
+#include "histogram.h"
+
+struct DeskServer;
+
+/*
+  The compositor's main loop. Backend sources (libinput, DRM, the session)
+  live on a wl_event_loop of their own, so each pass drains them before
+  any client request is dispatched and before any output renders, and
+  client dispatch gets a bounded slice of the pass.
+ */
+struct eventLoop {
+  struct wl_event_loop *backend;   // handed to the backend, and output frame timers
+  struct wl_event_loop *clients;   // the display's: client sockets, protocol idles
+  bool running;
+  int64_t clientsReadyNs;          // when clients were first seen waiting, 0 when not
+
+  /* Queueing delay of each source type since the last periodic log, in
+   * microseconds: input from its kernel timestamp to its handler, clients
+   * from readiness to dispatch, frames from their frame event to rendering */
+  struct histogram inputQueue;
+  struct histogram clientQueue;
+  struct histogram renderQueue;
+  int64_t lastLogNs;
+};
+
+void initEventLoop(struct eventLoop *, struct wl_display *);
+void finishEventLoop(struct eventLoop *);
+void runEventLoop(struct DeskServer *);
+// An input event stamped by the kernel at time_msec (CLOCK_MONOTONIC) is being handled
+void noteInputQueueing(struct eventLoop *, uint32_t time_msec);
+void logEventLoop(struct eventLoop *);
@@ -0,0 +1,69 @@
+#include "mesh.h"
+
+static struct mesh* newMesh(const GLfloat *vertices, GLsizeiptr size, GLsizei count) {
+  struct mesh *mesh = calloc(1, sizeof(struct mesh));
+  ASSERTN(mesh);
+  mesh->count = count;
+
+  GL_CHECK(glGenVertexArrays(1, &mesh->VAO));
+  GL_CHECK(glGenBuffers(1, &mesh->VBO));
+
+  glBindVertexArray(mesh->VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+  glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
+
+  return mesh;
+}
+
+/* Leave no VAO or buffer bound: wlroots draws with client-side arrays */
+void unbindMesh() {
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Unit quad (position, uv) that the model matrix scales up to the surface size
+struct mesh* newQuadMesh() {
+  GLfloat vertices[] = {
+    0.0f, 0.0f, 0.0f,   0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f,   0.0f, 1.0f,
+    1.0f, 0.0f, 0.0f,   1.0f, 0.0f,
+    1.0f, 1.0f, 0.0f,   1.0f, 1.0f,
+  };
+  struct mesh *mesh = newMesh(vertices, sizeof(vertices), 4);
+
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+
+  unbindMesh();
+  return mesh;
+}
+
+// Clip-space quad covering the whole viewport, for cursor and debug overlays
+struct mesh* newScreenMesh() {
+  GLfloat vertices[] = {
+    -1.0f, -1.0f,
+    -1.0f,  1.0f,
+     1.0f, -1.0f,
+     1.0f,  1.0f,
+  };
+  struct mesh *mesh = newMesh(vertices, sizeof(vertices), 4);
+
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  unbindMesh();
+  return mesh;
+}
+
+void destroyMesh(struct mesh *mesh) {
+  glDeleteBuffers(1, &mesh->VBO);
+  glDeleteVertexArrays(1, &mesh->VAO);
+  free(mesh);
+}
+
+void drawMesh(struct mesh *mesh) {
+  glBindVertexArray(mesh->VAO);
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, mesh->count);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdlib.h>
+#include "imports.h"
+
+/*
+  GPU-resident geometry drawn as a triangle strip
+ */
+struct mesh {
+  GLuint VAO;
+  GLuint VBO;
+  GLsizei count;
+};
+
+struct mesh* newQuadMesh();
+struct mesh* newScreenMesh();
+void destroyMesh(struct mesh *);
+void drawMesh(struct mesh *);
+void unbindMesh();
@@ -3,7 +3,81 @@
 #include "aux.h"
 #include <math.h>
 
-static void renderLayer(struct Output *output, struct wl_list *layer_list, float *depth);
+static void collectScene(struct Output *output);
+static void cullScene(struct Output *output, pixman_region32_t *damage);
+static void releaseSplits(struct Output *output);
+static void splitItem(struct RenderItem *item, pixman_region32_t *opaque,
+                      pixman_region32_t *translucent);
+static void renderScene(struct Output *output, bool depth);
+static void drawScene(struct Output *output, bool depth);
+static int delayedFrame(void *data);
+static void sendFrameCallbacks(struct Output *output);
+
+/* Upload the frame-constant uniforms for a width x height target into ubo
+ * and bind it as the Frame block */
+static void uploadFrameUniforms(GLuint ubo, int width, int height) {
+  struct frameUniforms frame = {
+    .projection = GLM_MAT4_IDENTITY_INIT,
+    .view = GLM_MAT4_IDENTITY_INIT,
+    .outputSize = { width, height },
+  };
+  glm_ortho(0, width, 0, height, -10.0f, 10.0f, frame.projection);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  frame.time = (now.tv_sec % 3600) + now.tv_nsec / 1e9f;
+
+  glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(frame), &frame, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, ubo);
+}
+
+/* Upload the frame-constant uniforms shared by every shader on this output */
+static void updateFrameUniforms(struct Output *output) {
+  uploadFrameUniforms(output->frameUBO, output->wlr_output->width, output->wlr_output->height);
+}
+
+/* Clamp a damage box to the output and make it the scissor rect */
+static bool scissorBox(pixman_box32_t *box, int width, int height) {
+  int x1 = box->x1 < 0 ? 0 : box->x1;
+  int y1 = box->y1 < 0 ? 0 : box->y1;
+  int x2 = box->x2 > width ? width : box->x2;
+  int y2 = box->y2 > height ? height : box->y2;
+  if (x2 <= x1 || y2 <= y1) {
+    return false;
+  }
+  glScissor(x1, y1, x2 - x1, y2 - y1);
+  return true;
+}
+
+/* wlroots only gives its output buffers a color attachment; hang a shared
+ * depth/stencil renderbuffer off whichever one is bound for this pass */
+static bool attachDepthStencil(struct Output *output) {
+  GLint fbo = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+  if (fbo == 0) {
+    return false;
+  }
+
+  int width = output->wlr_output->width;
+  int height = output->wlr_output->height;
+  if (!output->depthStencil ||
+      output->depthStencilWidth != width || output->depthStencilHeight != height) {
+    if (!output->depthStencil) {
+      glGenRenderbuffers(1, &output->depthStencil);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, output->depthStencil);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    output->depthStencilWidth = width;
+    output->depthStencilHeight = height;
+  }
+
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, output->depthStencil);
+  return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
 
 struct Output *mkOutput(struct DeskServer *container, struct wlr_output* data){
   struct Output *output = calloc(1, sizeof(struct Output));
@@ -13,9 +87,30 @@ struct Output *mkOutput(struct DeskServer *container, struct wlr_output* data){
   output->windowShader = NULL;
   output->frame_pending = false;
   output->needs_full_damage = true;
+  output->sceneDirty = true;
 
   wlr_damage_ring_init(&output->damage_ring);
-  pixman_region32_init(&output->prev_damage);
+  for (int i = 0; i < DAMAGE_HISTORY; i++) {
+    pixman_region32_init(&output->damageHistory[i]);
+    output->damageBuffers[i].output = output;
+  }
+  for (int i = 0; i < DEBUG_DAMAGE_FRAMES; i++) {
+    pixman_region32_init(&output->debugHistory[i]);
+  }
+  wl_array_init(&output->renderList);
+
+  for (int i = 0; i < RENDER_TIME_HISTORY; i++) {
+    output->renderTimes[i] = RENDER_TIME_INITIAL_US * 1000;
+  }
+  output->pendingCpuNs = -1;
+  histogramReset(&output->latency);
+  histogramReset(&output->latencyWindow);
+  output->lastLatencyLogNs = monotonicNs();
+  if (data->renderer) {
+    output->renderTimer = wlr_render_timer_create(data->renderer);
+  }
+  output->frameTimer = wl_event_loop_add_timer(
+    container->loop.backend, delayedFrame, output);
 
   for (int i = 0; i < 4; i++) {
     wl_list_init(&output->layers[i]);
@@ -26,6 +121,8 @@ struct Output *mkOutput(struct DeskServer *container, struct wlr_output* data){
   ATTACH(Output, output, data->events.frame, frame);
   ATTACH(Output, output, data->events.present, present);
   ATTACH(Output, output, data->events.request_state, requestState);
+  ATTACH(Output, output, data->events.damage, damage);
+  ATTACH(Output, output, data->events.needs_frame, needsFrame);
   ATTACH(Output, output, data->events.destroy, destroy);
 
   wl_list_insert(&container->outputs, &output->link);
@@ -33,12 +130,72 @@ struct Output *mkOutput(struct DeskServer *container, struct wlr_output* data){
   return output;
 }
 
+/* GL objects of the output, deleted on the renderer's context with
+ * whatever was current put back afterwards */
+static void releaseOutputGL(struct Output *output) {
+  struct wlr_egl *egl = wlr_gles2_renderer_get_egl(output->server->renderer);
+  struct wlr_egl_context saved;
+  if (!wlr_egl_make_current(egl, &saved)) {
+    LOG("Could not make the EGL context current, leaking %s's GL objects",
+        output->wlr_output->name);
+    return;
+  }
+
+  struct shader *shaders[] = {
+    output->windowShader, output->windowShaderExternal, output->cursorShader,
+    output->debugShader, output->overdrawShader, output->heatShader,
+  };
+  for (size_t i = 0; i < sizeof(shaders) / sizeof(shaders[0]); i++) {
+    if (shaders[i]) {
+      destroyShader(shaders[i]);
+    }
+  }
+  if (output->shader_initialized) {
+    glDeleteBuffers(1, &output->frameUBO);
+    glDeleteBuffers(1, &output->cacheUBO);
+    destroyMesh(output->quadMesh);
+    destroyMesh(output->screenMesh);
+    glDeleteTextures(1, &output->uiTexture);
+    finishDamageCostModel(&output->costModel);
+  }
+  if (output->sceneFBO) {
+    glDeleteFramebuffers(1, &output->sceneFBO);
+    glDeleteTextures(1, &output->sceneTexture);
+  }
+  if (output->overdrawFBO) {
+    glDeleteFramebuffers(1, &output->overdrawFBO);
+    glDeleteTextures(1, &output->overdrawTexture);
+    glDeleteRenderbuffers(1, &output->overdrawDepth);
+  }
+  if (output->depthStencil) {
+    glDeleteRenderbuffers(1, &output->depthStencil);
+  }
+
+  wlr_egl_restore_context(&saved);
+}
+
 void destroyOutput(struct Output *container){
+  releaseOutputGL(container);
+  wl_event_source_remove(container->frameTimer);
+  if (container->renderTimer) {
+    wlr_render_timer_destroy(container->renderTimer);
+  }
   wlr_damage_ring_finish(&container->damage_ring);
-  pixman_region32_fini(&container->prev_damage);
+  for (int i = 0; i < DAMAGE_HISTORY; i++) {
+    pixman_region32_fini(&container->damageHistory[i]);
+    if (container->damageBuffers[i].buffer) {
+      wl_list_remove(&container->damageBuffers[i].destroy.link);
+    }
+  }
+  for (int i = 0; i < DEBUG_DAMAGE_FRAMES; i++) {
+    pixman_region32_fini(&container->debugHistory[i]);
+  }
+  wl_array_release(&container->renderList);
   wl_list_remove(&container->frame.link);
   wl_list_remove(&container->present.link);
   wl_list_remove(&container->requestState.link);
+  wl_list_remove(&container->damage.link);
+  wl_list_remove(&container->needsFrame.link);
   wl_list_remove(&container->destroy.link);
   wl_list_remove(&container->link);
   free(container);
@@ -52,510 +209,2011 @@ void damageOutputWhole(struct Output *output) {
     .height = output->wlr_output->height,
   };
   wlr_damage_ring_add_box(&output->damage_ring, &box);
+  output->sceneDirty = true;
   wlr_output_schedule_frame(output->wlr_output);
 }
 
-void damageOutputBox(struct Output *output, struct wlr_box *box) {
-  wlr_damage_ring_add_box(&output->damage_ring, box);
-  wlr_output_schedule_frame(output->wlr_output);
-}
-
-HANDLE(frame, void, Output) {
-  if (container->frame_pending) {
+/* Clip layout-space damage to the output and bring it to buffer pixels the
+ * way wlroots does: origin, scale (grown a pixel when fractional), then
+ * the inverse of the output transform */
+static void layoutDamageToBuffer(struct Output *output, pixman_region32_t *damage) {
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_box box;
+  wlr_output_layout_get_box(output->server->outputLayout, wlr_output, &box);
+  if (wlr_box_empty(&box)) {
+    pixman_region32_clear(damage);
     return;
   }
 
-  int view_count = 0;
-  struct View *v;
-  wl_list_for_each(v, &container->server->views, link) {
-    view_count++;
-    if(v->fadeIn > 0) {
-      v->fadeIn -= 0.1f;
-      if(v->fadeIn > 0.0f) {
-        damageOutputWhole(container);
-      }
+  pixman_region32_intersect_rect(damage, damage, box.x, box.y, box.width, box.height);
+  pixman_region32_translate(damage, -box.x, -box.y);
+  if (wlr_output->scale != 1.0f) {
+    wlr_region_scale(damage, damage, wlr_output->scale);
+    if (floorf(wlr_output->scale) != wlr_output->scale) {
+      wlr_region_expand(damage, damage, 1);
     }
   }
-  static int once = 1;
-  if(once && view_count == 0) {
-    LOG("WARNING: No views to render");
-    once = 0;
-  }
 
-  if (container->needs_full_damage) {
-    damageOutputWhole(container);
-    container->needs_full_damage = false;
+  int width, height;
+  wlr_output_transformed_resolution(wlr_output, &width, &height);
+  wlr_region_transform(damage, damage, wlr_output_transform_invert(wlr_output->transform),
+                       width, height);
+}
+
+/* Add layout-space damage, scheduling a frame only if it hit the output */
+static void addLayoutDamage(struct Output *output, pixman_region32_t *region, bool scene) {
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  pixman_region32_copy(&damage, region);
+  layoutDamageToBuffer(output, &damage);
+
+  if (pixman_region32_not_empty(&damage)) {
+    wlr_damage_ring_add(&output->damage_ring, &damage);
+    output->sceneDirty |= scene;
+    wlr_output_schedule_frame(output->wlr_output);
   }
-  
+  pixman_region32_fini(&damage);
+}
 
+void damageOutputBox(struct Output *output, struct wlr_box *box) {
+  pixman_region32_t region;
+  pixman_region32_init_rect(&region, box->x, box->y, box->width, box->height);
+  addLayoutDamage(output, &region, true);
+  pixman_region32_fini(&region);
+}
 
-  struct wlr_output_state state;
-  wlr_output_state_init(&state);
+void damageOutputRegion(struct Output *output, pixman_region32_t *region) {
+  addLayoutDamage(output, region, true);
+}
 
-  container->pass = wlr_output_begin_render_pass(container->wlr_output, &state, NULL);
-  if (!container->pass) {
-    wlr_output_state_finish(&state);
-    return;
-  }
+/* Damage that only the cursor moved through; the scene cache still holds
+ * what is underneath */
+void damageOutputCursor(struct Output *output, struct wlr_box *box) {
+  pixman_region32_t region;
+  pixman_region32_init_rect(&region, box->x, box->y, box->width, box->height);
+  addLayoutDamage(output, &region, false);
+  pixman_region32_fini(&region);
+}
 
-  int output_width = container->wlr_output->width;
-  int output_height = container->wlr_output->height;
-  
-  /* Capture current frame damage for debug display before modifications */
-  pixman_region32_t debug_damage;
-  pixman_region32_init(&debug_damage);
-  if (container->server->debugDamage) {
-    pixman_region32_copy(&debug_damage, &container->damage_ring.current);
-    /* Force full redraw when debug mode is on to avoid double-buffer artifacts */
-    struct wlr_box full = { 0, 0, output_width, output_height };
-    wlr_damage_ring_add_box(&container->damage_ring, &full);
-  }
-  
-  /* Accumulate current + previous frame damage for double buffering */
-  pixman_region32_t accumulated_damage;
-  pixman_region32_init(&accumulated_damage);
-  pixman_region32_union(&accumulated_damage, &container->damage_ring.current, &container->prev_damage);
-  
-  /* Save current damage for next frame, then clear */
-  pixman_region32_copy(&container->prev_damage, &container->damage_ring.current);
-  pixman_region32_clear(&container->damage_ring.current);
-  
-  /* Get individual damage rectangles for efficient scissoring */
-  int num_rects = 0;
-  pixman_box32_t *damage_rects = pixman_region32_rectangles(&accumulated_damage, &num_rects);
-  
-  /* If no damage, skip rendering entirely */
-  if (num_rects == 0) {
-    pixman_region32_fini(&accumulated_damage);
-    wlr_render_pass_submit(container->pass);
-    wlr_output_commit_state(container->wlr_output, &state);
-    wlr_output_state_finish(&state);
-    return;
+/* Rebuild layoutToBuffer to match layoutDamageToBuffer, for this frame */
+static void updateLayoutTransform(struct Output *output) {
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_box box;
+  wlr_output_layout_get_box(output->server->outputLayout, wlr_output, &box);
+  int width, height;
+  wlr_output_transformed_resolution(wlr_output, &width, &height);
+
+  /* Buffer position as a*x + b*y + c, d*x + e*y + f of the transformed
+   * position, per wlr_region_transform */
+  float a = 1, b = 0, c = 0, d = 0, e = 1, f = 0;
+  switch (wlr_output_transform_invert(wlr_output->transform)) {
+  case WL_OUTPUT_TRANSFORM_NORMAL:
+    break;
+  case WL_OUTPUT_TRANSFORM_90:
+    a = 0; b = -1; c = height; d = 1; e = 0;
+    break;
+  case WL_OUTPUT_TRANSFORM_180:
+    a = -1; c = width; e = -1; f = height;
+    break;
+  case WL_OUTPUT_TRANSFORM_270:
+    a = 0; b = 1; d = -1; e = 0; f = width;
+    break;
+  case WL_OUTPUT_TRANSFORM_FLIPPED:
+    a = -1; c = width;
+    break;
+  case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+    a = 0; b = -1; c = height; d = -1; e = 0; f = width;
+    break;
+  case WL_OUTPUT_TRANSFORM_FLIPPED_180:
+    e = -1; f = height;
+    break;
+  case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+    a = 0; b = 1; d = 1; e = 0;
+    break;
   }
 
-  /* Initialize shader on first frame when GL context is available (within render pass) */
-  if (!container->shader_initialized) {
-   container->windowShader = newShader(WINDOW_VERTEX_SHADER, WINDOW_FRAGMENT_SHADER);
-   if (!container->windowShader) {
-     LOG("Failed to load shader, skipping frame");
-     wlr_output_state_finish(&state);
-     return;
-   }
-   container->windowShaderExternal = newShader(WINDOW_VERTEX_SHADER, WINDOW_FRAGMENT_SHADER_EXTERNAL);
-   if (!container->windowShaderExternal) {
-     LOG("Failed to load external shader, skipping frame");
-     wlr_output_state_finish(&state);
-     return;
-   }
-   container->cursorShader = newShader(CURSOR_VERTEX_SHADER, CURSOR_FRAGMENT_SHADER);
-   if (!container->cursorShader) {
-     LOG("Failed to load cursor shader, skipping frame");
-     wlr_output_state_finish(&state);
-     return;
-   }
-   container->debugShader = newShader(DEBUG_VERTEX_SHADER, DEBUG_FRAGMENT_SHADER);
-   if (!container->debugShader) {
-     LOG("Failed to load debug shader, skipping frame");
-     wlr_output_state_finish(&state);
-     return;
-   }
-   GL_CHECK(glGenTextures(1, &container->uiTexture));
-   
-   /* Create screen texture for cursor effect */
-   GL_CHECK(glGenTextures(1, &container->screenTexture));
-   glBindTexture(GL_TEXTURE_2D, container->screenTexture);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 
-                container->wlr_output->width, container->wlr_output->height,
-                0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-   
-   container->shader_initialized = true;
-   LOG("Shaders initialized successfully");
+  mat4 transform = GLM_MAT4_IDENTITY_INIT;
+  transform[0][0] = a;
+  transform[1][0] = b;
+  transform[3][0] = c;
+  transform[0][1] = d;
+  transform[1][1] = e;
+  transform[3][1] = f;
+
+  glm_mat4_identity(output->layoutToBuffer);
+  glm_scale(output->layoutToBuffer, (vec3){wlr_output->scale, wlr_output->scale, 1});
+  glm_translate(output->layoutToBuffer, (vec3){-box.x, -box.y, 0});
+  glm_mat4_mul(transform, output->layoutToBuffer, output->layoutToBuffer);
+}
+
+/* The cursor has to be composited whenever the lens is on this output, or
+ * wlroots fell back to a software cursor for lack of a cursor plane */
+static bool cursorNeedsComposite(struct Output *output) {
+  if (!output->server->lensCursor) {
+    struct wlr_output_cursor *cursor;
+    wl_list_for_each(cursor, &output->wlr_output->cursors, link) {
+      if (cursor->enabled && cursor->visible &&
+          output->wlr_output->hardware_cursor != cursor) {
+        return true;
+      }
+    }
+    return false;
   }
 
-  /* Begin GL rendering within the render pass */
-  glEnable(GL_SCISSOR_TEST);
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  struct wlr_box box;
+  wlr_output_layout_get_box(output->server->outputLayout, output->wlr_output, &box);
+  int radius = CURSOR_LENS_RADIUS;
+  box.x -= radius;
+  box.y -= radius;
+  box.width += radius * 2;
+  box.height += radius * 2;
+  return wlr_box_contains_point(&box, output->server->cursor->x, output->server->cursor->y);
+}
 
-  /* Render each damage rectangle separately for efficiency */
-  for (int rect_idx = 0; rect_idx < num_rects; rect_idx++) {
-    pixman_box32_t *rect = &damage_rects[rect_idx];
-    
-    int scissor_x = rect->x1;
-    int scissor_y = rect->y1;
-    int scissor_width = rect->x2 - rect->x1;
-    int scissor_height = rect->y2 - rect->y1;
-    
-    /* Clamp to valid range */
-    if (scissor_x < 0) scissor_x = 0;
-    if (scissor_y < 0) scissor_y = 0;
-    if (scissor_width <= 0 || scissor_height <= 0) continue;
-    
-    glScissor(scissor_x, scissor_y, scissor_width, scissor_height);
-    
-    glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+static void countBufferedIter(struct wlr_surface *surface, int x, int y, void *data) {
+  if (wlr_surface_has_buffer(surface)) {
+    (*(int*)data)++;
+  }
+}
 
-    useShader(container->windowShader);
-    
-    /* Setup projection for orthographic view */
-    mat4 proj = GLM_MAT4_IDENTITY_INIT;
-    glm_ortho(0, container->wlr_output->width, 0, container->wlr_output->height, -10.0f, 10.0f, proj);
-    set4fv(container->windowShader, "projection", 1, GL_FALSE, (float*)proj);
-    
-    mat4 view_mat = GLM_MAT4_IDENTITY_INIT;
-    set4fv(container->windowShader, "view", 1, GL_FALSE, (float*)view_mat);
+/* The surface of the topmost view, if it alone fills the output with opaque
+ * pixels and its buffer can go to the display unmodified */
+static struct wlr_surface *scanoutCandidate(struct Output *output) {
+  struct DeskServer *server = output->server;
+  struct wlr_output *wlr_output = output->wlr_output;
 
-    /* Render in layer order: BACKGROUND -> BOTTOM -> views -> TOP -> OVERLAY */
-    float depth = -9;
+  if (server->debugDamage || cursorNeedsComposite(output)) {
+    return NULL;
+  }
+  if (wlr_output->scale != 1.0f || wlr_output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+    return NULL;
+  }
 
-    /* BACKGROUND layer (layer 0) */
-    renderLayer(container, &container->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND], &depth);
+  /* Anything in the upper layers would be drawn on top */
+  for (int layer = ZWLR_LAYER_SHELL_V1_LAYER_TOP; layer <= ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY; layer++) {
+    struct LayerSurface *ls;
+    wl_list_for_each(ls, &output->layers[layer], link) {
+      if (ls->mapped) {
+        return NULL;
+      }
+    }
+  }
 
-    /* BOTTOM layer (layer 1) */
-    renderLayer(container, &container->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM], &depth);
+  struct View *view = NULL, *e;
+  wl_list_for_each(e, &server->views, link) {
+    if (e->xdg && e->xdg->surface && e->xdg->surface->mapped) {
+      view = e;
+      break;
+    }
+  }
+  if (!view || view->rot != 0.0f || view->scale != 1.0f) {
+    return NULL;
+  }
 
-    /* Regular views (back-to-front: focused view is at front of list, should render last) */
-    struct View *e;
-    wl_list_for_each_reverse(e, &container->server->views, link) {
-      if (!e->xdg || !e->xdg->surface || !e->xdg->surface->mapped) {
-        depth++;
-        continue;
-      }
+  /* No subsurfaces or popups with content of their own */
+  int buffered = 0;
+  wlr_xdg_surface_for_each_surface(view->xdg, countBufferedIter, &buffered);
+  struct wlr_surface *surface = view->xdg->surface;
+  if (buffered != 1 || !surface->buffer) {
+    return NULL;
+  }
 
-      struct RenderContext renderContext = {
-        .output = container,
-        .view = e,
-        .offsetX = 0,
-        .offsetY = 0,
-        .depth = depth,
-      };
+  struct wlr_box box;
+  wlr_output_layout_get_box(server->outputLayout, wlr_output, &box);
+  if (view->x != box.x || view->y != box.y ||
+      surface->current.width != wlr_output->width ||
+      surface->current.height != wlr_output->height ||
+      surface->current.buffer_width != wlr_output->width ||
+      surface->current.buffer_height != wlr_output->height ||
+      surface->current.scale != 1 ||
+      surface->current.transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+    return NULL;
+  }
 
-      /* Iterate all surfaces in the xdg tree (toplevel + popups + subsurfaces) */
-      wlr_xdg_surface_for_each_surface(e->xdg, renderSurfaceIter, &renderContext);
-      depth++;
+  struct wlr_texture *texture = wlr_surface_get_texture(surface);
+  if (!texture) {
+    return NULL;
+  }
+  struct wlr_gles2_texture_attribs attribs;
+  wlr_gles2_texture_get_attribs(texture, &attribs);
+  if (attribs.has_alpha) {
+    pixman_box32_t full = { 0, 0, wlr_output->width, wlr_output->height };
+    if (pixman_region32_contains_rectangle(&surface->opaque_region, &full) != PIXMAN_REGION_IN) {
+      return NULL;
     }
+  }
 
-    /* TOP layer (layer 2) */
-    renderLayer(container, &container->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP], &depth);
+  return surface;
+}
 
-    /* OVERLAY layer (layer 3) */
-    renderLayer(container, &container->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY], &depth);
+static void damageBufferDestroy(struct wl_listener *listener, void *data) {
+  struct DamageBuffer *slot = wl_container_of(listener, slot, destroy);
+  wl_list_remove(&slot->destroy.link);
+  slot->buffer = NULL;
+  slot->frame = 0;
+}
 
-    /* Capture screen content for cursor effect (clamped to screen bounds) */
-    int copy_x = scissor_x;
-    int copy_y = scissor_y;
-    int copy_w = scissor_width;
-    int copy_h = scissor_height;
-    if (copy_x + copy_w > output_width) copy_w = output_width - copy_x;
-    if (copy_y + copy_h > output_height) copy_h = output_height - copy_y;
-    if (copy_w > 0 && copy_h > 0) {
-      glBindTexture(GL_TEXTURE_2D, container->screenTexture);
-      glCopyTexSubImage2D(GL_TEXTURE_2D, 0, copy_x, copy_y, copy_x, copy_y, copy_w, copy_h);
+/* The slot tracking buffer, taking over a free or the stalest one */
+static struct DamageBuffer *damageBufferSlot(struct Output *output, struct wlr_buffer *buffer) {
+  struct DamageBuffer *victim = &output->damageBuffers[0];
+  for (int i = 0; i < DAMAGE_HISTORY; i++) {
+    struct DamageBuffer *slot = &output->damageBuffers[i];
+    if (slot->buffer == buffer) {
+      return slot;
     }
-
-    /* Draw fancy cursor */
-    useShader(container->cursorShader);
-    
-    float cursorX = container->server->cursor->x;
-    float cursorY = container->server->cursor->y;
-    float radius = 14.0f;
-    
-    glUniform2f(glGetUniformLocation(container->cursorShader->ID, "u_resolution"),
-                (float)container->wlr_output->width, (float)container->wlr_output->height);
-    glUniform2f(glGetUniformLocation(container->cursorShader->ID, "u_center"),
-                cursorX, cursorY);
-    glUniform1f(glGetUniformLocation(container->cursorShader->ID, "u_radius"), radius);
-    
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, container->screenTexture);
-    glUniform1i(glGetUniformLocation(container->cursorShader->ID, "u_screen_texture"), 0);
-    
-    /* Draw cursor quad using immediate vertex data */
-    GLfloat cursorVertices[] = {
-      -1.0f, -1.0f,
-       1.0f, -1.0f,
-       1.0f,  1.0f,
-      -1.0f, -1.0f,
-       1.0f,  1.0f,
-      -1.0f,  1.0f,
-    };
-    
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), cursorVertices);
-    glEnableVertexAttribArray(0);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-    glDisableVertexAttribArray(0);
-    
-  }
-  
-  /* Debug: draw damage region overlay after all rendering */
-  if (container->server->debugDamage) {
-    int debug_num_rects = 0;
-    pixman_box32_t *debug_rects = pixman_region32_rectangles(&debug_damage, &debug_num_rects);
-    
-    if (debug_num_rects > 0) {
-      useShader(container->debugShader);
-      glUniform4f(glGetUniformLocation(container->debugShader->ID, "u_color"), 1.0f, 0.0f, 0.0f, 0.5f);
-      
-      for (int rect_idx = 0; rect_idx < debug_num_rects; rect_idx++) {
-        pixman_box32_t *rect = &debug_rects[rect_idx];
-        
-        int scissor_x = rect->x1;
-        int scissor_y = rect->y1;
-        int scissor_width = rect->x2 - rect->x1;
-        int scissor_height = rect->y2 - rect->y1;
-        
-        if (scissor_x < 0) scissor_x = 0;
-        if (scissor_y < 0) scissor_y = 0;
-        if (scissor_width <= 0 || scissor_height <= 0) continue;
-        
-        glScissor(scissor_x, scissor_y, scissor_width, scissor_height);
-        
-        GLfloat debugVertices[] = {
-          -1.0f, -1.0f,
-           1.0f, -1.0f,
-           1.0f,  1.0f,
-          -1.0f, -1.0f,
-           1.0f,  1.0f,
-          -1.0f,  1.0f,
-        };
-        
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), debugVertices);
-        glEnableVertexAttribArray(0);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glDisableVertexAttribArray(0);
-      }
+    if (!slot->buffer || (victim->buffer && slot->frame < victim->frame)) {
+      victim = slot;
     }
   }
-  
-  pixman_region32_fini(&debug_damage);
-  pixman_region32_fini(&accumulated_damage);
-  
-  /* Disable scissor after all rendering is complete */
-  glDisable(GL_SCISSOR_TEST);
 
-  if (!wlr_render_pass_submit(container->pass)) {
-    LOG("Failed to submit render pass");
-    wlr_output_state_finish(&state);
-    return;
+  if (victim->buffer) {
+    wl_list_remove(&victim->destroy.link);
   }
+  victim->buffer = buffer;
+  victim->frame = 0;
+  victim->destroy.notify = damageBufferDestroy;
+  wl_signal_add(&buffer->events.destroy, &victim->destroy);
+  return victim;
+}
 
-  container->frame_pending = true;
-  if (!wlr_output_commit_state(container->wlr_output, &state)) {
-    container->frame_pending = false;
-    wlr_output_schedule_frame(container->wlr_output);
+/* Contents of every swapchain buffer are unknown from here on */
+static void forgetBufferDamage(struct Output *output) {
+  for (int i = 0; i < DAMAGE_HISTORY; i++) {
+    output->damageBuffers[i].frame = 0;
   }
+}
 
-  wlr_output_state_finish(&state);
+/* Record this frame's damage and work out what the acquired buffer needs
+ * repainted: the damage of every frame since it was last painted, or all
+ * of it when that is unknown or too long ago */
+static void bufferDamage(struct Output *output, struct wlr_buffer *buffer,
+                         pixman_region32_t *out) {
+  uint64_t frame = ++output->frameCount;
+  pixman_region32_copy(&output->damageHistory[frame % DAMAGE_HISTORY],
+                       &output->damage_ring.current);
+
+  struct DamageBuffer *slot = buffer ? damageBufferSlot(output, buffer) : NULL;
+  uint64_t age = slot && slot->frame ? frame - slot->frame : 0;
+  if (age == 0 || age > DAMAGE_HISTORY) {
+    pixman_region32_fini(out);
+    pixman_region32_init_rect(out, 0, 0, output->wlr_output->width, output->wlr_output->height);
+  } else {
+    pixman_region32_clear(out);
+    for (uint64_t i = 0; i < age; i++) {
+      pixman_region32_union(out, out, &output->damageHistory[(frame - i) % DAMAGE_HISTORY]);
+    }
+  }
+
+  if (slot) {
+    slot->frame = frame;
+  }
 }
 
-HANDLE(present, struct wlr_output_event_present, Output) {
-  container->frame_pending = false;
-  /* Only schedule next frame if there's pending damage */
-  if (!pixman_region32_not_empty(&container->damage_ring.current)) {
+/* Back to compositing: the swapchain buffers are stale, repaint all of them */
+static void leaveDirectScanout(struct Output *output) {
+  if (!output->scanout) {
     return;
   }
-  wlr_output_schedule_frame(container->wlr_output);
+  LOG("Direct scanout on %s: off", output->wlr_output->name);
+  output->scanout = false;
+
+  struct wlr_box full = { 0, 0, output->wlr_output->width, output->wlr_output->height };
+  wlr_damage_ring_add_box(&output->damage_ring, &full);
+  forgetBufferDamage(output);
+  output->sceneDirty = true;
 }
 
-HANDLE(requestState, struct wlr_output_event_request_state, Output) {
-  LOG ("State request");
-  wlr_output_commit_state(container->wlr_output, data->state);
+/* The view filling this output as fullscreen, if any */
+static struct View *fullscreenView(struct Output *output) {
+  struct wlr_box box, clip;
+  wlr_output_layout_get_box(output->server->outputLayout, output->wlr_output, &box);
+
+  struct View *view;
+  wl_list_for_each(view, &output->server->views, link) {
+    if (view->fullscreen && view->xdg && viewNode(view)->visible &&
+        wlr_box_intersection(&clip, &viewNode(view)->bounds, &box)) {
+      return view;
+    }
+  }
+  return NULL;
 }
 
-HANDLE(destroy, struct wlr_output, Output) {
-  LOG ("Destroying %s", data->name);
+/* Adaptive sync while a fullscreen view, or a view hinting game or video
+ * content, is on this output */
+static bool wantsAdaptiveSync(struct Output *output) {
+  if (fullscreenView(output)) {
+    return true;
+  }
 
-  destroyOutput(container);
+  struct wlr_box box, clip;
+  wlr_output_layout_get_box(output->server->outputLayout, output->wlr_output, &box);
+  struct View *view;
+  wl_list_for_each(view, &output->server->views, link) {
+    if (!view->xdg || !view->xdg->surface || !viewNode(view)->visible ||
+        !wlr_box_intersection(&clip, &viewNode(view)->bounds, &box)) {
+      continue;
+    }
+    enum wp_content_type_v1_type type =
+      wlr_surface_get_content_type_v1(output->server->contentType, view->xdg->surface);
+    if (type == WP_CONTENT_TYPE_V1_TYPE_GAME || type == WP_CONTENT_TYPE_V1_TYPE_VIDEO) {
+      return true;
+    }
+  }
+  return false;
 }
 
-void printPoint(struct point p) {
-  LOG("%.1f %.1f", p.x, p.y);
+/* Async page flips only for a fullscreen view that asked for them */
+static bool wantsTearing(struct Output *output) {
+  struct View *view = fullscreenView(output);
+  return view && wlr_tearing_control_manager_v1_surface_hint_from_surface(
+    output->server->tearingControl, view->xdg->surface) == WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC;
 }
 
-// wlr_surface_iterator_func_t
-void renderSurfaceIter(struct wlr_surface *surface, int x, int y, void *data) {
-  struct RenderContext *ctx = (struct RenderContext*)data;
+/* Fold the adaptive sync and tearing policy into a frame's state. Each is
+ * tried with a test commit first and dropped if the backend refuses it; a
+ * refused setting isn't tried again until the policy changes. */
+static void applyPresentationPolicy(struct Output *output, struct wlr_output_state *state) {
+  struct wlr_output *wlr_output = output->wlr_output;
 
-  struct wlr_texture *texture = wlr_surface_get_texture(surface);
-  if (!texture) {
-    goto frame_done;
+  bool vrr = wantsAdaptiveSync(output);
+  if (vrr != output->vrrWanted) {
+    output->vrrWanted = vrr;
+    output->vrrRefused = false;
+  }
+  bool enabled = wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+  if (vrr != enabled && !output->vrrRefused) {
+    wlr_output_state_set_adaptive_sync_enabled(state, vrr);
+    if (wlr_output_test_state(wlr_output, state)) {
+      LOG("Adaptive sync on %s: %s", wlr_output->name, vrr ? "on" : "off");
+    } else {
+      LOG("Adaptive sync %s refused on %s", vrr ? "enabling" : "disabling", wlr_output->name);
+      state->committed &= ~WLR_OUTPUT_STATE_ADAPTIVE_SYNC_ENABLED;
+      output->vrrRefused = true;
+    }
   }
 
+  bool tearing = wantsTearing(output);
+  if (tearing != output->tearingWanted) {
+    output->tearingWanted = tearing;
+    output->tearingRefused = false;
+    LOG("Tearing on %s: %s", wlr_output->name, tearing ? "requested" : "off");
+  }
+  if (tearing && !output->tearingRefused) {
+    state->tearing_page_flip = true;
+    if (!wlr_output_test_state(wlr_output, state)) {
+      LOG("Async page flips refused on %s", wlr_output->name);
+      state->tearing_page_flip = false;
+      output->tearingRefused = true;
+    }
+  }
+}
 
-  int width = surface->current.width;
-  int height = surface->current.height;
+/* Put the candidate's client buffer straight on the primary plane. Returns
+ * false, leaving the frame to be composited, whenever that isn't possible. */
+static bool tryDirectScanout(struct Output *output) {
+  struct wlr_surface *surface = scanoutCandidate(output);
+  if (!surface) {
+    leaveDirectScanout(output);
+    return false;
+  }
 
-  /* Get the underlying GL texture from wlroots */
-  struct wlr_gles2_texture_attribs attribs;
-  wlr_gles2_texture_get_attribs(texture, &attribs);
+  struct wlr_output_state state;
+  wlr_output_state_init(&state);
+  wlr_output_state_set_buffer(&state, &surface->buffer->base);
 
-  /* Select shader based on texture target */
-  struct shader *shader = (attribs.target == GL_TEXTURE_EXTERNAL_OES) 
-    ? ctx->output->windowShaderExternal 
-    : ctx->output->windowShader;
-  useShader(shader);
+  if (!wlr_output_test_state(output->wlr_output, &state)) {
+    DEBUG("Direct scanout rejected on %s, compositing", output->wlr_output->name);
+    wlr_output_state_finish(&state);
+    leaveDirectScanout(output);
+    return false;
+  }
+  applyPresentationPolicy(output, &state);
+  wlr_presentation_surface_scanned_out_on_output(surface, output->wlr_output);
 
-  /* Setup projection for orthographic view */
-  mat4 proj = GLM_MAT4_IDENTITY_INIT;
-  glm_ortho(0, ctx->output->wlr_output->width, 0, ctx->output->wlr_output->height, -10.0f, 10.0f, proj);
-  set4fv(shader, "projection", 1, GL_FALSE, (float*)proj);
-  
-  mat4 view = GLM_MAT4_IDENTITY_INIT;
-  set4fv(shader, "view", 1, GL_FALSE, (float*)view);
+  output->frame_pending = true;
+  if (!wlr_output_commit_state(output->wlr_output, &state)) {
+    output->frame_pending = false;
+    wlr_output_state_finish(&state);
+    leaveDirectScanout(output);
+    return false;
+  }
+  wlr_output_state_finish(&state);
 
-  /* Setup model matrix with rotation */
-  mat4 model = GLM_MAT4_IDENTITY_INIT;
-  
-  /* Get view's main surface extents for rotation center */
-  struct wlr_box view_box = {0};
-  wlr_surface_get_extents(ctx->view->xdg->surface, &view_box);
-  
-  /* Rotation pivot is the view's center (main surface center) */
-  float pivot_x = ctx->view->x + view_box.width / 2.0f;
-  float pivot_y = ctx->view->y + view_box.height / 2.0f;
-  
-  /* This surface's position relative to view origin */
-  float surface_x = ctx->view->x + x;
-  float surface_y = ctx->view->y + y;
-  
-  /* Translate to pivot, rotate, translate back, then position surface */
-  glm_translate(model, (vec3){pivot_x, pivot_y, ctx->depth});
-  if (ctx->view->rot != 0.0f) {
-    glm_rotate_z(model, ctx->view->rot, model);
+  if (!output->scanout) {
+    LOG("Direct scanout on %s: on", output->wlr_output->name);
+    output->scanout = true;
   }
-  /* Translate from pivot to surface position */
-  glm_translate(model, (vec3){surface_x - pivot_x, surface_y - pivot_y, 0});
 
-  set4fv(shader, "model", 1, GL_FALSE, (float*)model);
+  /* Composition is skipped entirely, so is whatever damage it had */
+  pixman_region32_clear(&output->damage_ring.current);
+  return true;
+}
 
-  /* Bind texture and render quad */
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(attribs.target, attribs.tex);
-  
-  /* Set texture parameters - important for external textures */
-  glTexParameteri(attribs.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(attribs.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(attribs.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(attribs.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  
-  glUniform1i(glGetUniformLocation(shader->ID, "s_texture"), 0);
-
-  /* Vertex data for quad */
-  GLfloat vVertices[] = {
-    0,  0, 0.0f,    0.0f,  0.0f,
-    0, height, 0.0f, 0.0f,  1.0f,
-    width, height, 0.0f, 1.0f,  1.0f,
-    width,  0, 0.0f, 1.0f,  0.0f
-  };
-  GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
+/* (Re)allocate the offscreen scene copy to the output size. A new cache is
+ * empty, so the whole output is damaged to fill it. */
+static void ensureSceneCache(struct Output *output) {
+  int width = output->wlr_output->width;
+  int height = output->wlr_output->height;
+  if (output->sceneFBO && output->sceneWidth == width && output->sceneHeight == height) {
+    return;
+  }
 
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), vVertices);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), &vVertices[3]);
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
+  GLint fbo = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
 
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
+  if (!output->sceneFBO) {
+    GL_CHECK(glGenFramebuffers(1, &output->sceneFBO));
+    GL_CHECK(glGenTextures(1, &output->sceneTexture));
+  }
+  glBindTexture(GL_TEXTURE_2D, output->sceneTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, output->sceneFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         output->sceneTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    LOG("Scene cache framebuffer incomplete on %s", output->wlr_output->name);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+  output->sceneWidth = width;
+  output->sceneHeight = height;
+
+  struct wlr_box full = { 0, 0, width, height };
+  wlr_damage_ring_add_box(&output->damage_ring, &full);
+  output->sceneDirty = true;
+}
+
+/* Copy a box between the bound output buffer and the scene cache. Blits are
+ * subject to the scissor test, so it is dropped for the copy. */
+static void blitScene(struct Output *output, pixman_box32_t *box, bool toCache) {
+  GLint fbo = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+
+  int x1 = box->x1 < 0 ? 0 : box->x1;
+  int y1 = box->y1 < 0 ? 0 : box->y1;
+  int x2 = box->x2 > output->sceneWidth ? output->sceneWidth : box->x2;
+  int y2 = box->y2 > output->sceneHeight ? output->sceneHeight : box->y2;
+  if (x2 <= x1 || y2 <= y1) {
+    return;
+  }
+
+  GLboolean scissor = glIsEnabled(GL_SCISSOR_TEST);
+  glDisable(GL_SCISSOR_TEST);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, toCache ? fbo : output->sceneFBO);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, toCache ? output->sceneFBO : fbo);
+  glBlitFramebuffer(x1, y1, x2, y2, x1, y1, x2, y2, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  if (scissor) {
+    glEnable(GL_SCISSOR_TEST);
+  }
+}
+
+/* Only cursor damage is pending and the cache holds the scene underneath:
+ * the frame can be rebuilt without walking the scene at all */
+static bool cursorOnlyFrame(struct Output *output) {
+  return !output->sceneDirty && output->sceneFBO && !output->server->debugDamage;
+}
+
+/* Draw the lens cursor, sampling the cached scene around it, into the parts
+ * of the damage it covers. Undamaged pixels may already hold the lens. */
+static void renderLensCursor(struct Output *output, pixman_region32_t *damage) {
+  vec3 center;
+  glm_mat4_mulv3(output->layoutToBuffer,
+                 (vec3){output->server->cursor->x, output->server->cursor->y, 0}, 1.0f, center);
+  double x = center[0];
+  double y = center[1];
+  float lensRadius = CURSOR_LENS_RADIUS * output->wlr_output->scale;
+  int radius = (int)ceilf(lensRadius) + 1;
+
+  pixman_region32_t lens;
+  pixman_region32_init_rect(&lens, (int)x - radius, (int)y - radius,
+                            radius * 2 + 1, radius * 2 + 1);
+  pixman_region32_intersect(&lens, &lens, damage);
+
+  int num_rects = 0;
+  pixman_box32_t *rects = pixman_region32_rectangles(&lens, &num_rects);
+  if (num_rects > 0) {
+    useShader(output->cursorShader);
+    set2f(output->cursorShader, U_CENTER, x, y);
+    setFloat(output->cursorShader, U_RADIUS, lensRadius);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, output->sceneTexture);
+
+    for (int i = 0; i < num_rects; i++) {
+      if (scissorBox(&rects[i], output->wlr_output->width, output->wlr_output->height)) {
+        drawMesh(output->screenMesh);
+        output->stats.drawCalls++;
+      }
+    }
+  }
+  pixman_region32_fini(&lens);
+}
+
+/* (Re)create the overdraw counter target at output size. It has its own
+ * depth buffer so the replay rejects the same fragments early-z does. */
+static void ensureOverdrawBuffer(struct Output *output) {
+  int width = output->wlr_output->width;
+  int height = output->wlr_output->height;
+  if (output->overdrawFBO && output->overdrawWidth == width && output->overdrawHeight == height) {
+    return;
+  }
+
+  GLint fbo = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+
+  if (!output->overdrawFBO) {
+    glGenFramebuffers(1, &output->overdrawFBO);
+    glGenTextures(1, &output->overdrawTexture);
+    glGenRenderbuffers(1, &output->overdrawDepth);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, output->overdrawTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glBindRenderbuffer(GL_RENDERBUFFER, output->overdrawDepth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, output->overdrawFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         output->overdrawTexture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, output->overdrawDepth);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    LOG("Overdraw framebuffer incomplete on %s", output->wlr_output->name);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+  output->overdrawWidth = width;
+  output->overdrawHeight = height;
+}
+
+/* Replay this frame's draws into the overdraw target, adding one count per
+ * fragment that survives the depth test */
+static void renderOverdraw(struct Output *output, bool depth) {
+  ensureOverdrawBuffer(output);
+
+  GLint fbo = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, output->overdrawFBO);
+
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
+
+  output->overdrawPass = true;
+  drawScene(output, depth);
+  output->overdrawPass = false;
+
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+/* Debug overlay: overdraw heatmap, then the last frames' damage fading out
+ * with age, newest on top */
+static void renderDebugOverlay(struct Output *output, pixman_region32_t *damage, bool overdraw) {
+  int width = output->wlr_output->width;
+  int height = output->wlr_output->height;
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  if (overdraw) {
+    pixman_box32_t full = { 0, 0, width, height };
+    scissorBox(&full, width, height);
+    useShader(output->heatShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, output->overdrawTexture);
+    drawMesh(output->screenMesh);
+    output->stats.drawCalls++;
+  }
+
+  output->debugHistoryHead = (output->debugHistoryHead + 1) % DEBUG_DAMAGE_FRAMES;
+  pixman_region32_copy(&output->debugHistory[output->debugHistoryHead], damage);
+
+  useShader(output->debugShader);
+  for (int age = DEBUG_DAMAGE_FRAMES - 1; age >= 0; age--) {
+    int slot = (output->debugHistoryHead - age + DEBUG_DAMAGE_FRAMES) % DEBUG_DAMAGE_FRAMES;
+    int num_rects = 0;
+    pixman_box32_t *rects = pixman_region32_rectangles(&output->debugHistory[slot], &num_rects);
+    if (num_rects == 0) {
+      continue;
+    }
+
+    float fade = 1.0f - (float)age / DEBUG_DAMAGE_FRAMES;
+    set4f(output->debugShader, U_COLOR, 1.0f, 0.0f, 0.0f, 0.5f * fade * fade);
+    for (int i = 0; i < num_rects; i++) {
+      if (scissorBox(&rects[i], width, height)) {
+        drawMesh(output->screenMesh);
+        output->stats.drawCalls++;
+      }
+    }
+  }
+}
+
+/* Keep frames coming until the damage history has faded out */
+static bool debugHistoryPending(struct Output *output) {
+  for (int i = 0; i < DEBUG_DAMAGE_FRAMES; i++) {
+    if (pixman_region32_not_empty(&output->debugHistory[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct ViewCacheContext {
+  struct Output *output;
+  struct View *view;
+  pixman_box32_t box;           // view-relative extents of the textured tree
+  int surfaces;
+};
+
+static void viewCacheExtentsIter(struct wlr_surface *surface, int x, int y, void *data) {
+  struct ViewCacheContext *ctx = data;
+  if (!wlr_surface_get_texture(surface)) {
+    return;
+  }
+
+  pixman_box32_t box = { x, y, x + surface->current.width, y + surface->current.height };
+  if (ctx->surfaces++ == 0) {
+    ctx->box = box;
+    return;
+  }
+  if (box.x1 < ctx->box.x1) ctx->box.x1 = box.x1;
+  if (box.y1 < ctx->box.y1) ctx->box.y1 = box.y1;
+  if (box.x2 > ctx->box.x2) ctx->box.x2 = box.x2;
+  if (box.y2 > ctx->box.y2) ctx->box.y2 = box.y2;
+}
+
+static void viewCacheDrawIter(struct wlr_surface *surface, int x, int y, void *data) {
+  struct ViewCacheContext *ctx = data;
+  struct wlr_texture *texture = wlr_surface_get_texture(surface);
+  if (!texture) {
+    return;
+  }
+
+  struct wlr_gles2_texture_attribs attribs;
+  wlr_gles2_texture_get_attribs(texture, &attribs);
+  struct shader *shader = (attribs.target == GL_TEXTURE_EXTERNAL_OES)
+    ? ctx->output->windowShaderExternal
+    : ctx->output->windowShader;
+  useShader(shader);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(attribs.target, attribs.tex);
+  glTexParameteri(attribs.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(attribs.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  int width = surface->current.width;
+  int height = surface->current.height;
+  int cx = x - ctx->box.x1;
+  int cy = y - ctx->box.y1;
+
+  mat4 model = GLM_MAT4_IDENTITY_INIT;
+  glm_translate(model, (vec3){cx, cy, 0});
+  glm_scale(model, (vec3){width, height, 1});
+  set4fv(shader, U_MODEL, 1, GL_FALSE, (float*)model);
+  set4f(shader, U_TEX_RECT, 0.0f, 0.0f, 1.0f, 1.0f);
+  drawMesh(ctx->output->quadMesh);
+  ctx->output->stats.drawCalls++;
+
+  /* Opaque parts of the composite, in cache coordinates */
+  pixman_region32_t opaque;
+  if (!attribs.has_alpha) {
+    pixman_region32_init_rect(&opaque, 0, 0, width, height);
+  } else {
+    pixman_region32_init(&opaque);
+    pixman_region32_intersect_rect(&opaque, &surface->opaque_region, 0, 0, width, height);
+  }
+  pixman_region32_translate(&opaque, cx, cy);
+  pixman_region32_union(&ctx->view->cacheOpaque, &ctx->view->cacheOpaque, &opaque);
+  pixman_region32_fini(&opaque);
+}
+
+/* Only transformed trees of several surfaces gain from drawing as one quad */
+static bool viewWantsCache(struct View *view, struct ViewCacheContext *ctx) {
+  bool transformed = view->rot != 0.0f || viewAnimating(view);
+  return transformed && ctx->surfaces > 1;
+}
+
+void releaseViewCache(struct View *view) {
+  if (!view->cacheFBO) {
+    return;
+  }
+
+  /* Called outside rendering too; borrow the renderer's context and put
+   * back whatever was current */
+  struct wlr_egl *egl = wlr_gles2_renderer_get_egl(view->server->renderer);
+  struct wlr_egl_context saved;
+  if (wlr_egl_make_current(egl, &saved)) {
+    glDeleteFramebuffers(1, &view->cacheFBO);
+    glDeleteTextures(1, &view->cacheTexture);
+    wlr_egl_restore_context(&saved);
+  }
+  view->cacheFBO = 0;
+  view->cacheTexture = 0;
+  view->cacheWidth = view->cacheHeight = 0;
+  view->cacheDirty = true;
+}
+
+/* Composite the view's tree, unrotated, into its cache. The result is
+ * premultiplied so it can be blended once more as a whole. */
+static void refreshViewCache(struct Output *output, struct View *view, struct ViewCacheContext *ctx) {
+  int width = ctx->box.x2 - ctx->box.x1;
+  int height = ctx->box.y2 - ctx->box.y1;
+
+  GLint fbo = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+
+  if (!view->cacheFBO) {
+    GL_CHECK(glGenFramebuffers(1, &view->cacheFBO));
+    GL_CHECK(glGenTextures(1, &view->cacheTexture));
+  }
+  if (view->cacheWidth != width || view->cacheHeight != height) {
+    glBindTexture(GL_TEXTURE_2D, view->cacheTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, view->cacheFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           view->cacheTexture, 0);
+    view->cacheWidth = width;
+    view->cacheHeight = height;
+    view->cacheDirty = true;
+  }
+  if (view->cacheX != ctx->box.x1 || view->cacheY != ctx->box.y1) {
+    view->cacheX = ctx->box.x1;
+    view->cacheY = ctx->box.y1;
+    view->cacheDirty = true;
+  }
+  if (!view->cacheDirty) {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    return;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, view->cacheFBO);
+  glViewport(0, 0, width, height);
+  glDisable(GL_SCISSOR_TEST);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  glEnable(GL_BLEND);
+  glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  uploadFrameUniforms(output->cacheUBO, width, height);
+
+  pixman_region32_clear(&view->cacheOpaque);
+  wlr_xdg_surface_for_each_surface(view->xdg, viewCacheDrawIter, ctx);
+  unbindMesh();
+
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(0, 0, output->wlr_output->width, output->wlr_output->height);
+  view->cacheDirty = false;
+}
+
+/* Bring every view's cache in line with whether it is rotated or moving;
+ * collectScene then draws those views from their cache */
+static void refreshViewCaches(struct Output *output) {
+  struct View *view;
+  wl_list_for_each(view, &output->server->views, link) {
+    if (!view->xdg || !view->xdg->surface || !view->xdg->surface->mapped) {
+      continue;
+    }
+
+    struct ViewCacheContext ctx = { .output = output, .view = view };
+    wlr_xdg_surface_for_each_surface(view->xdg, viewCacheExtentsIter, &ctx);
+    if (viewWantsCache(view, &ctx)) {
+      refreshViewCache(output, view, &ctx);
+    } else {
+      releaseViewCache(view);
+    }
+  }
+}
+
+/* Fold the last frame's render time into the history: its CPU time, or
+ * the GPU-inclusive time of its render pass when that is known */
+static void recordRenderTime(struct Output *output) {
+  if (output->pendingCpuNs < 0) {
+    return;
+  }
+
+  int64_t sample = output->pendingCpuNs;
+  if (output->renderTimerPending) {
+    int gpu = wlr_render_timer_get_duration_ns(output->renderTimer);
+    if (gpu > sample) {
+      sample = gpu;
+    }
+    output->renderTimerPending = false;
+  }
+  output->renderTimes[output->renderTimeHead] = sample;
+  output->renderTimeHead = (output->renderTimeHead + 1) % RENDER_TIME_HISTORY;
+  output->pendingCpuNs = -1;
+}
+
+/* The slowest recent frame is what the next one has to allow for */
+static int64_t predictRenderTime(struct Output *output) {
+  int64_t worst = 0;
+  for (int i = 0; i < RENDER_TIME_HISTORY; i++) {
+    if (output->renderTimes[i] > worst) {
+      worst = output->renderTimes[i];
+    }
+  }
+  return worst;
+}
+
+/* Pick the first vblank the next frame can still make and return how long
+ * rendering it can wait. Without presentation timing it can't wait. */
+static int64_t planFrame(struct Output *output) {
+  output->targetVblankNs = 0;
+  if (output->refreshNs <= 0 || output->lastPresent.tv_sec == 0) {
+    return 0;
+  }
+
+  int64_t now = monotonicNs();
+  int64_t refresh = output->refreshNs;
+  int64_t budget = predictRenderTime(output) + RENDER_SAFETY_MARGIN_US * 1000;
+  int64_t vblank = timespecToNs(&output->lastPresent) + refresh;
+  if (vblank - budget < now) {
+    vblank += ((now - (vblank - budget)) / refresh + 1) * refresh;
+  }
+  output->targetVblankNs = vblank;
+  return vblank - budget - now;
+}
+
+static void renderOutput(struct Output *container);
+
+/* Render now, latching the newest input and animation state */
+static void renderFrame(struct Output *output) {
+  recordRenderTime(output);
+
+  int64_t start = monotonicNs();
+  struct timespec when = nsToTimespec(output->targetVblankNs ? output->targetVblankNs : start);
+  animateViews(output->server, &when);
+
+  /* Input is only taken by a commit that succeeds, empty-damage ones
+   * included; without one it is left for the next frame */
+  int64_t input = output->pendingInputNs;
+  renderOutput(output);
+  if (input && output->frame_pending) {
+    output->inflightInputNs = input;
+    output->pendingInputNs = 0;
+  }
+  output->pendingCpuNs = monotonicNs() - start;
+  sendFrameCallbacks(output);
+}
+
+/* Rendering waits for the end of the event loop pass, after every ready
+ * input event has been handled */
+static void queueFrame(struct Output *output) {
+  if (!output->renderQueued) {
+    output->renderQueued = true;
+    output->renderQueuedNs = monotonicNs();
+  }
+}
+
+static int delayedFrame(void *data) {
+  struct Output *output = data;
+  output->frameDelayed = false;
+  if (!output->frame_pending) {
+    queueFrame(output);
+  }
+  return 0;
+}
+
+HANDLE(frame, void, Output) {
+  if (container->frame_pending || container->frameDelayed || container->renderQueued) {
+    return;
+  }
+
+  /* The timer only has millisecond resolution; round the wait down */
+  int64_t delay = planFrame(container);
+  if (delay >= 1000000) {
+    container->frameDelayed = true;
+    wl_event_source_timer_update(container->frameTimer, delay / 1000000);
+    return;
+  }
+  queueFrame(container);
+}
+
+bool outputsQueued(struct DeskServer *server) {
+  struct Output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    if (output->renderQueued) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void renderQueuedOutputs(struct DeskServer *server) {
+  struct Output *output, *tmp;
+  wl_list_for_each_safe(output, tmp, &server->outputs, link) {
+    if (!output->renderQueued) {
+      continue;
+    }
+    output->renderQueued = false;
+    if (output->frame_pending) {
+      continue;
+    }
+    histogramAdd(&server->loop.renderQueue, (monotonicNs() - output->renderQueuedNs) / 1000);
+    renderFrame(output);
+  }
+}
+
+static void renderOutput(struct Output *container) {
+  static int once = 1;
+  if(once && wl_list_empty(&container->server->views)) {
+    LOG("WARNING: No views to render");
+    once = 0;
+  }
+
+  if (container->needs_full_damage) {
+    damageOutputWhole(container);
+    container->needs_full_damage = false;
+  }
+
+  if (tryDirectScanout(container)) {
+    return;
+  }
+
+  struct wlr_output_state state;
+  wlr_output_state_init(&state);
+
+  struct wlr_buffer_pass_options options = { .timer = container->renderTimer };
+  container->pass = wlr_output_begin_render_pass(container->wlr_output, &state, &options);
+  if (!container->pass) {
+    wlr_output_state_finish(&state);
+    return;
+  }
+  container->renderTimerPending = container->renderTimer != NULL;
+
+  /* Initialize shader on first frame when GL context is available (within render pass) */
+  if (!container->shader_initialized) {
+   container->windowShader = newShader(WINDOW_VERTEX_SHADER, WINDOW_FRAGMENT_SHADER);
+   if (!container->windowShader) {
+     LOG("Failed to load shader, skipping frame");
+     wlr_output_state_finish(&state);
+     return;
+   }
+   container->windowShaderExternal = newShader(WINDOW_VERTEX_SHADER, WINDOW_FRAGMENT_SHADER_EXTERNAL);
+   if (!container->windowShaderExternal) {
+     LOG("Failed to load external shader, skipping frame");
+     wlr_output_state_finish(&state);
+     return;
+   }
+   container->cursorShader = newShader(CURSOR_VERTEX_SHADER, CURSOR_FRAGMENT_SHADER);
+   if (!container->cursorShader) {
+     LOG("Failed to load cursor shader, skipping frame");
+     wlr_output_state_finish(&state);
+     return;
+   }
+   container->debugShader = newShader(DEBUG_VERTEX_SHADER, DEBUG_FRAGMENT_SHADER);
+   if (!container->debugShader) {
+     LOG("Failed to load debug shader, skipping frame");
+     wlr_output_state_finish(&state);
+     return;
+   }
+   container->overdrawShader = newShader(WINDOW_VERTEX_SHADER, DEBUG_FRAGMENT_SHADER);
+   if (!container->overdrawShader) {
+     LOG("Failed to load overdraw shader, skipping frame");
+     wlr_output_state_finish(&state);
+     return;
+   }
+   container->heatShader = newShader(DEBUG_VERTEX_SHADER, HEATMAP_FRAGMENT_SHADER);
+   if (!container->heatShader) {
+     LOG("Failed to load heatmap shader, skipping frame");
+     wlr_output_state_finish(&state);
+     return;
+   }
+   GL_CHECK(glGenBuffers(1, &container->frameUBO));
+   GL_CHECK(glGenBuffers(1, &container->cacheUBO));
+   container->quadMesh = newQuadMesh();
+   container->screenMesh = newScreenMesh();
+   GL_CHECK(glGenTextures(1, &container->uiTexture));
+   initDamageCostModel(&container->costModel);
+
+   container->shader_initialized = true;
+   LOG("Shaders initialized successfully");
+  }
+
+  ensureSceneCache(container);
+  updateLayoutTransform(container);
+
+  int output_width = container->wlr_output->width;
+  int output_height = container->wlr_output->height;
+  
+  /* Capture current frame damage for debug display before modifications */
+  pixman_region32_t debug_damage;
+  pixman_region32_init(&debug_damage);
+  if (container->server->debugDamage) {
+    pixman_region32_copy(&debug_damage, &container->damage_ring.current);
+    /* Force full redraw when debug mode is on to avoid double-buffer artifacts */
+    struct wlr_box full = { 0, 0, output_width, output_height };
+    wlr_damage_ring_add_box(&container->damage_ring, &full);
+  }
+  
+  /* Bring the acquired buffer up to date with every frame it missed */
+  pixman_region32_t accumulated_damage;
+  pixman_region32_init(&accumulated_damage);
+  bufferDamage(container, state.buffer, &accumulated_damage);
+  pixman_region32_clear(&container->damage_ring.current);
+  
+  /* Get individual damage rectangles to build the stencil mask from */
+  int num_rects = 0;
+  pixman_box32_t *damage_rects = pixman_region32_rectangles(&accumulated_damage, &num_rects);
+  int raw_rects = num_rects;
+  
+  /* If no damage, skip rendering entirely */
+  if (num_rects == 0) {
+    pixman_region32_fini(&debug_damage);
+    pixman_region32_fini(&accumulated_damage);
+    wlr_render_pass_submit(container->pass);
+    applyPresentationPolicy(container, &state);
+    /* Still a frame on screen, e.g. a hardware cursor move */
+    container->frame_pending = true;
+    if (!wlr_output_commit_state(container->wlr_output, &state)) {
+      container->frame_pending = false;
+    }
+    wlr_output_state_finish(&state);
+    return;
+  }
+
+
+  /* Trade rect count against overdraw. Debug mode repaints everything, so
+   * the overlay shows what the real damage would have been reshaped to. */
+  enum damageStrategy strategy;
+  if (container->server->debugDamage) {
+    raw_rects = pixman_region32_n_rects(&debug_damage);
+    strategy = simplifyDamage(&container->costModel, &debug_damage, output_width, output_height);
+  } else {
+    strategy = simplifyDamage(&container->costModel, &accumulated_damage,
+                              output_width, output_height);
+    damage_rects = pixman_region32_rectangles(&accumulated_damage, &num_rects);
+  }
+
+  /* Begin GL rendering within the render pass */
+  container->stats.drawCalls = 0;
+  container->stats.damageRects = container->server->debugDamage
+    ? pixman_region32_n_rects(&debug_damage) : num_rects;
+  container->stats.rawDamageRects = raw_rects;
+  container->stats.strategy = strategy;
+  container->stats.culledSurfaces = 0;
+  container->stats.surfacesDrawn = 0;
+  container->stats.pixelsShaded = 0;
+
+  pixman_box32_t *extents = pixman_region32_extents(&accumulated_damage);
+  bool stencil = false;
+  bool overdraw = false;
+
+  /* Cursor-only frame: restore the scene under the damage from the cache
+   * and draw the lens on top, whatever the number of windows */
+  if (cursorOnlyFrame(container)) {
+    for (int rect_idx = 0; rect_idx < num_rects; rect_idx++) {
+      blitScene(container, &damage_rects[rect_idx], false);
+    }
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    if (container->server->lensCursor) {
+      updateFrameUniforms(container);
+      renderLensCursor(container, &accumulated_damage);
+    }
+    goto render_done;
+  }
+
+  refreshViewCaches(container);
+
+  stencil = attachDepthStencil(container);
+  if (stencil) {
+    beginDamageTiming(&container->costModel, &accumulated_damage);
+  }
+
+  glEnable(GL_SCISSOR_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glClearColor(0.8f, 0.8f, 0.8f, 1.0f);
+
+  /* Restrict rasterization to the damage region with a stencil mask, so the
+   * scene below is walked once per frame however fragmented the damage is */
+  if (stencil) {
+    glStencilMask(0xFF);
+    scissorBox(extents, output_width, output_height);
+    glClearStencil(0);
+    glClear(GL_STENCIL_BUFFER_BIT);
+
+    glClearStencil(1);
+    glClearDepthf(1.0f);
+    glDepthMask(GL_TRUE);
+    for (int rect_idx = 0; rect_idx < num_rects; rect_idx++) {
+      if (scissorBox(&damage_rects[rect_idx], output_width, output_height)) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+      }
+    }
+
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_EQUAL, 1, 0xFF);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+    glStencilMask(0);
+  } else {
+    /* No stencil attachment: repaint the bounding box of the damage instead */
+    DEBUG("Stencil unavailable, repainting damage extents");
+    pixman_box32_t box = *extents;
+    pixman_region32_reset(&accumulated_damage, &box);
+  }
+
+  if (!scissorBox(extents, output_width, output_height)) {
+    goto render_done;
+  }
+  if (!stencil) {
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+
+  updateFrameUniforms(container);
+
+  collectScene(container);
+  cullScene(container, &accumulated_damage);
+  renderScene(container, stencil);
+  if (container->server->debugDamage) {
+    /* Keep the replay out of the cost model's timing */
+    endDamageTiming(&container->costModel);
+    renderOverdraw(container, stencil);
+    overdraw = true;
+  }
+  releaseSplits(container);
+
+  /* Keep the cursor-free scene for the lens and for cursor-only frames.
+   * Only what was repainted is known to be free of an older lens. */
+  damage_rects = pixman_region32_rectangles(&accumulated_damage, &num_rects);
+  for (int rect_idx = 0; rect_idx < num_rects; rect_idx++) {
+    blitScene(container, &damage_rects[rect_idx], true);
+  }
+  container->sceneDirty = false;
+
+  if (container->server->lensCursor) {
+    renderLensCursor(container, &accumulated_damage);
+  }
+
+render_done:
+  endDamageTiming(&container->costModel);
+  unbindMesh();
+  if (stencil) {
+    glDisable(GL_STENCIL_TEST);
+    glStencilMask(0xFF);
+  }
+
+  /* Debug: overdraw heatmap, damage history and counters on top of the frame */
+  if (container->server->debugDamage) {
+    renderDebugOverlay(container, &debug_damage, overdraw);
+    renderUI(container);
+    unbindMesh();
+    DEBUG("frame: %d -> %d damage rects (%s), %d draw calls, %d surfaces drawn, "
+          "%d culled, %.2f Mpx shaded",
+          container->stats.rawDamageRects, container->stats.damageRects,
+          damageStrategyName(container->stats.strategy), container->stats.drawCalls,
+          container->stats.surfacesDrawn, container->stats.culledSurfaces,
+          container->stats.pixelsShaded / 1e6);
+  } else if (debugHistoryPending(container)) {
+    for (int i = 0; i < DEBUG_DAMAGE_FRAMES; i++) {
+      pixman_region32_clear(&container->debugHistory[i]);
+    }
+  }
+  
+  /* Disable scissor after all rendering is complete */
+  glDisable(GL_SCISSOR_TEST);
 
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
+  /* Cursors wlroots could not put on a cursor plane */
+  wlr_output_add_software_cursors_to_render_pass(container->wlr_output, container->pass,
+                                                 &accumulated_damage);
 
-frame_done:
-  struct timespec now;
-  clock_gettime(CLOCK_MONOTONIC, &now);
-  wlr_surface_send_frame_done(surface, &now);
+  pixman_region32_fini(&debug_damage);
+  pixman_region32_fini(&accumulated_damage);
+
+  if (!wlr_render_pass_submit(container->pass)) {
+    LOG("Failed to submit render pass");
+    /* The frame's damage was taken but never painted */
+    forgetBufferDamage(container);
+    container->needs_full_damage = true;
+    wlr_output_state_finish(&state);
+    return;
+  }
+
+  applyPresentationPolicy(container, &state);
+
+  container->frame_pending = true;
+  if (!wlr_output_commit_state(container->wlr_output, &state)) {
+    container->frame_pending = false;
+    wlr_output_schedule_frame(container->wlr_output);
+  }
+
+  wlr_output_state_finish(&state);
+}
+
+HANDLE(present, struct wlr_output_event_present, Output) {
+  container->frame_pending = false;
+  if (data->presented) {
+    container->lastPresent = data->when;
+    container->refreshNs = data->refresh;
+
+    /* Landed a refresh or more after the vblank it was rendered for */
+    int64_t late = timespecToNs(&data->when) - container->targetVblankNs;
+    if (container->targetVblankNs && late > data->refresh / 2) {
+      container->missedFrames++;
+      DEBUG("%s missed its vblank by %.2f ms (%d missed, %.2f ms predicted render time)",
+            container->wlr_output->name, late / 1e6, container->missedFrames,
+            predictRenderTime(container) / 1e6);
+    }
+    container->targetVblankNs = 0;
+
+    if (container->inflightInputNs) {
+      int64_t latency = timespecToNs(&data->when) - container->inflightInputNs;
+      histogramAdd(&container->latency, latency / 1000);
+      histogramAdd(&container->latencyWindow, latency / 1000);
+    }
+    int64_t now = monotonicNs();
+    if (now - container->lastLatencyLogNs >= (int64_t)LATENCY_LOG_INTERVAL * 1000000000 &&
+        container->latencyWindow.count > 0) {
+      char label[64];
+      snprintf(label, sizeof(label), "%s input latency, last %ds",
+               container->wlr_output->name, LATENCY_LOG_INTERVAL);
+      histogramLog(&container->latencyWindow, label);
+      histogramReset(&container->latencyWindow);
+      container->lastLatencyLogNs = now;
+    }
+  }
+  container->inflightInputNs = 0;
+  /* Only schedule next frame if there's pending damage, a view still
+   * animating, or damage history the debug overlay is still fading out */
+  if (!pixman_region32_not_empty(&container->damage_ring.current) &&
+      !container->server->animating &&
+      !(container->server->debugDamage && debugHistoryPending(container))) {
+    return;
+  }
+  wlr_output_schedule_frame(container->wlr_output);
+}
+
+void noteOutputInput(struct Output *output, int64_t ns) {
+  if (ns > output->pendingInputNs) {
+    output->pendingInputNs = ns;
+  }
+}
+
+void logOutputLatency(struct Output *output) {
+  char label[64];
+  snprintf(label, sizeof(label), "%s input latency", output->wlr_output->name);
+  histogramLog(&output->latency, label);
+}
+
+/* wlroots damaging the output itself, e.g. for a moving software cursor */
+HANDLE(damage, struct wlr_output_event_damage, Output) {
+  wlr_damage_ring_add(&container->damage_ring, data->damage);
+  wlr_output_schedule_frame(container->wlr_output);
+}
+
+HANDLE(needsFrame, void, Output) {
+  wlr_output_schedule_frame(container->wlr_output);
+}
+
+HANDLE(requestState, struct wlr_output_event_request_state, Output) {
+  LOG ("State request");
+  wlr_output_commit_state(container->wlr_output, data->state);
+}
+
+HANDLE(destroy, struct wlr_output, Output) {
+  LOG ("Destroying %s", data->name);
+
+  destroyOutput(container);
+}
+
+void printPoint(struct point p) {
+  LOG("%.1f %.1f", p.x, p.y);
+}
+
+/* Append a textured surface to the frame's render list */
+static struct RenderItem *pushRenderItem(struct Output *output, mat4 model, float rot) {
+  struct RenderItem *item = wl_array_add(&output->renderList, sizeof(struct RenderItem));
+  ASSERTN(item);
+  item->surface = NULL;
+  item->cachedView = NULL;
+  item->rot = rot;
+  item->culled = false;
+  glm_mat4_mul(output->layoutToBuffer, model, item->model);
+
+  /* Buffer-space bounding box of the transformed quad */
+  float corners[4][2] = { {0, 0}, {1, 0}, {0, 1}, {1, 1} };
+  float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+  for (int i = 0; i < 4; i++) {
+    vec3 p;
+    glm_mat4_mulv3(model, (vec3){corners[i][0], corners[i][1], 0}, 1.0f, p);
+    if (p[0] < min_x) min_x = p[0];
+    if (p[0] > max_x) max_x = p[0];
+    if (p[1] < min_y) min_y = p[1];
+    if (p[1] > max_y) max_y = p[1];
+  }
+  item->bounds.x = (int)floorf(min_x);
+  item->bounds.y = (int)floorf(min_y);
+  item->bounds.width = (int)ceilf(max_x) - item->bounds.x;
+  item->bounds.height = (int)ceilf(max_y) - item->bounds.y;
+  return item;
+}
+
+static void addRenderItem(struct Output *output, struct wlr_surface *surface,
+                          struct wlr_texture *texture, mat4 model, float rot) {
+  struct RenderItem *item = pushRenderItem(output, model, rot);
+  item->surface = surface;
+  item->width = surface->current.width;
+  item->height = surface->current.height;
+  wlr_gles2_texture_get_attribs(texture, &item->attribs);
 }
 
+/* The view's cache as one quad, transformed the way collectSurfaceIter
+ * transforms each of its surfaces */
+static void addViewCacheItem(struct Output *output, struct View *view) {
+  struct SceneNode *node = viewNode(view);
+  mat4 model;
+  glm_mat4_copy(node->transform, model);
+  glm_translate(model, (vec3){view->cacheX, view->cacheY, 0});
+  glm_scale(model, (vec3){view->cacheWidth, view->cacheHeight, 1});
+
+  struct RenderItem *item = pushRenderItem(output, model, node->rot);
+  item->cachedView = view;
+  item->width = view->cacheWidth;
+  item->height = view->cacheHeight;
+  item->attribs = (struct wlr_gles2_texture_attribs){
+    .target = GL_TEXTURE_2D,
+    .tex = view->cacheTexture,
+    .has_alpha = true,
+  };
+}
+
+// wlr_surface_iterator_func_t
+void collectSurfaceIter(struct wlr_surface *surface, int x, int y, void *data) {
+  struct RenderContext *ctx = (struct RenderContext*)data;
+
+  struct wlr_texture *texture = wlr_surface_get_texture(surface);
+  if (!texture) {
+    return;
+  }
+
+  int width = surface->current.width;
+  int height = surface->current.height;
+
+  /* Place the surface within the view, then the view's node places it in
+   * the layout */
+  struct SceneNode *node = viewNode(ctx->view);
+  mat4 model;
+  glm_mat4_copy(node->transform, model);
+  glm_translate(model, (vec3){x, y, 0});
+  /* Scale the unit quad up to the surface size */
+  glm_scale(model, (vec3){width, height, 1});
+
+  addRenderItem(ctx->output, surface, texture, model, node->rot);
+}
+
+/* Debug HUD in the top-left corner: the damage strategy and the cost model
+ * it was chosen with, drawn with cairo and uploaded to uiTexture */
 void renderUI(struct Output *output) {
+  int width = 420, height = 88;
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  cairo_t *cr = cairo_create(surface);
+
+  cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.6);
+  cairo_paint(cr);
+  cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, 13.0);
+  cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+
+  char line[128];
+  struct damageCostModel *model = &output->costModel;
+  snprintf(line, sizeof(line), "damage %s: %d -> %d rects",
+           damageStrategyName(output->stats.strategy),
+           output->stats.rawDamageRects, output->stats.damageRects);
+  cairo_move_to(cr, 8, 18);
+  cairo_show_text(cr, line);
+  snprintf(line, sizeof(line), "cost %.0fus + %.1fus/rect + %.0fus/Mpx (%s)",
+           model->fixedUs, model->rectUs, model->mpixelUs,
+           model->timerQueries ? "timed" : "estimate");
+  cairo_move_to(cr, 8, 38);
+  cairo_show_text(cr, line);
+  snprintf(line, sizeof(line), "%.2f Mpx shaded, %d surfaces drawn, %d culled",
+           output->stats.pixelsShaded / 1e6, output->stats.surfacesDrawn,
+           output->stats.culledSurfaces);
+  cairo_move_to(cr, 8, 58);
+  cairo_show_text(cr, line);
+  snprintf(line, sizeof(line), "%d draw calls, %.2f ms budget, %d missed",
+           output->stats.drawCalls,
+           (predictRenderTime(output) + RENDER_SAFETY_MARGIN_US * 1000) / 1e6,
+           output->missedFrames);
+  cairo_move_to(cr, 8, 78);
+  cairo_show_text(cr, line);
+
+  cairo_destroy(cr);
+  cairo_surface_flush(surface);
+
+  /* Cairo's ARGB32 is premultiplied BGRA in memory */
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, output->uiTexture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, cairo_image_surface_get_stride(surface) / 4);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT, width, height, 0, GL_BGRA_EXT,
+               GL_UNSIGNED_BYTE, cairo_image_surface_get_data(surface));
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  cairo_surface_destroy(surface);
+
+  pixman_box32_t box = { 8, 8, 8 + width, 8 + height };
+  if (!scissorBox(&box, output->wlr_output->width, output->wlr_output->height)) {
+    return;
+  }
 
+  useShader(output->windowShader);
+  mat4 model_mat = GLM_MAT4_IDENTITY_INIT;
+  glm_translate(model_mat, (vec3){box.x1, box.y1, 0});
+  glm_scale(model_mat, (vec3){width, height, 1});
+  set4fv(output->windowShader, U_MODEL, 1, GL_FALSE, (float*)model_mat);
+  set4f(output->windowShader, U_TEX_RECT, 0.0f, 0.0f, 1.0f, 1.0f);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  drawMesh(output->quadMesh);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  output->stats.drawCalls++;
 }
 
-void renderLayerSurfaceIter(struct wlr_surface *surface, int x, int y, void *data) {
+void collectLayerSurfaceIter(struct wlr_surface *surface, int x, int y, void *data) {
   struct LayerRenderContext *ctx = (struct LayerRenderContext*)data;
 
   struct wlr_texture *texture = wlr_surface_get_texture(surface);
   if (!texture) {
-    goto frame_done;
+    return;
   }
 
   int width = surface->current.width;
   int height = surface->current.height;
 
+  mat4 model;
+  glm_mat4_copy(ctx->node->transform, model);
+  glm_translate(model, (vec3){x, y, 0});
+  glm_scale(model, (vec3){width, height, 1});
+
+  addRenderItem(ctx->output, surface, texture, model, 0.0f);
+}
+
+static void collectLayer(struct Output *output, struct wl_list *layer_list) {
+  struct LayerSurface *ls;
+  wl_list_for_each(ls, layer_list, link) {
+    struct SceneNode *node = layerNode(ls);
+    if (!node->visible) {
+      continue;
+    }
+
+    struct LayerRenderContext ctx = {
+      .output = output,
+      .node = node,
+    };
+
+    wlr_surface_for_each_surface(ls->layer_surface->surface, 
+                                  collectLayerSurfaceIter, &ctx);
+  }
+}
+
+/* Build this frame's render list, back-to-front:
+ * BACKGROUND -> BOTTOM -> views -> TOP -> OVERLAY */
+static void collectScene(struct Output *output) {
+  output->renderList.size = 0;
+
+  collectLayer(output, &output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
+  collectLayer(output, &output->layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
+
+  struct wlr_box outputBox, clip;
+  wlr_output_layout_get_box(output->server->outputLayout, output->wlr_output, &outputBox);
+
+  /* Regular views (back-to-front: focused view is at front of list, should render last) */
+  struct View *e;
+  wl_list_for_each_reverse(e, &output->server->views, link) {
+    if (!e->xdg || !viewNode(e)->visible) {
+      continue;
+    }
+    /* Views on other outputs only */
+    if (!wlr_box_intersection(&clip, &viewNode(e)->bounds, &outputBox)) {
+      continue;
+    }
+
+    struct RenderContext renderContext = {
+      .output = output,
+      .view = e,
+    };
+
+    if (e->cacheFBO && !e->cacheDirty) {
+      addViewCacheItem(output, e);
+      continue;
+    }
+
+    /* Iterate all surfaces in the xdg tree (toplevel + popups + subsurfaces) */
+    wlr_xdg_surface_for_each_surface(e->xdg, collectSurfaceIter, &renderContext);
+  }
+
+  collectLayer(output, &output->layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+  collectLayer(output, &output->layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+
+  /* Give every item its own depth inside the (-10, 10) ortho range, front
+   * items nearest, so subsurfaces of one view depth-sort correctly too */
+  struct RenderItem *items = output->renderList.data;
+  int count = output->renderList.size / sizeof(struct RenderItem);
+  for (int i = 0; i < count; i++) {
+    items[i].model[3][2] = -9.0f + 18.0f * (i + 1) / (count + 1);
+  }
+}
+
+/* Surface-local region an item covers with opaque pixels */
+static void itemSurfaceOpaque(struct RenderItem *item, pixman_region32_t *out) {
+  int width = item->width;
+  int height = item->height;
+  if (item->cachedView) {
+    pixman_region32_copy(out, &item->cachedView->cacheOpaque);
+  } else if (!item->attribs.has_alpha) {
+    pixman_region32_union_rect(out, out, 0, 0, width, height);
+  } else {
+    pixman_region32_intersect_rect(out, &item->surface->opaque_region, 0, 0, width, height);
+  }
+}
+
+/* Output-space region an item is guaranteed to cover with opaque pixels.
+ * Rotated rects only contribute the square inscribed in their inscribed
+ * circle, which stays inside the rect whatever the angle. */
+static void itemOpaqueRegion(struct RenderItem *item, pixman_region32_t *out) {
+  int width = item->width;
+  int height = item->height;
+
+  pixman_region32_t local;
+  pixman_region32_init(&local);
+  itemSurfaceOpaque(item, &local);
+
+  int num_rects = 0;
+  pixman_box32_t *rects = pixman_region32_rectangles(&local, &num_rects);
+  for (int i = 0; i < num_rects && width > 0 && height > 0; i++) {
+    pixman_box32_t *r = &rects[i];
+    int x1, y1, x2, y2;
+    if (item->rot == 0.0f) {
+      vec3 a, b;
+      glm_mat4_mulv3(item->model, (vec3){(float)r->x1 / width, (float)r->y1 / height, 0}, 1.0f, a);
+      glm_mat4_mulv3(item->model, (vec3){(float)r->x2 / width, (float)r->y2 / height, 0}, 1.0f, b);
+      /* The output transform may flip or swap the axes */
+      x1 = (int)ceilf(fminf(a[0], b[0]));
+      y1 = (int)ceilf(fminf(a[1], b[1]));
+      x2 = (int)floorf(fmaxf(a[0], b[0]));
+      y2 = (int)floorf(fmaxf(a[1], b[1]));
+    } else {
+      vec3 c;
+      float cx = (r->x1 + r->x2) / 2.0f;
+      float cy = (r->y1 + r->y2) / 2.0f;
+      glm_mat4_mulv3(item->model, (vec3){cx / width, cy / height, 0}, 1.0f, c);
+      float w = r->x2 - r->x1;
+      float h = r->y2 - r->y1;
+      float half = (w < h ? w : h) / 2.0f / sqrtf(2.0f);
+      x1 = (int)ceilf(c[0] - half);
+      y1 = (int)ceilf(c[1] - half);
+      x2 = (int)floorf(c[0] + half);
+      y2 = (int)floorf(c[1] + half);
+    }
+    if (x2 > x1 && y2 > y1) {
+      pixman_region32_union_rect(out, out, x1, y1, x2 - x1, y2 - y1);
+    }
+  }
+  pixman_region32_fini(&local);
+}
+
+/* Walk the render list front-to-back against the damage, culling every
+ * item left with no visible area once the opaque items above it are
+ * subtracted */
+static void cullScene(struct Output *output, pixman_region32_t *damage) {
+  pixman_region32_t clip, opaque;
+  pixman_region32_init(&clip);
+  pixman_region32_init(&opaque);
+  pixman_region32_copy(&clip, damage);
+
+  struct RenderItem *items = output->renderList.data;
+  int count = output->renderList.size / sizeof(struct RenderItem);
+  for (int i = count - 1; i >= 0; i--) {
+    struct RenderItem *item = &items[i];
+    struct wlr_box *b = &item->bounds;
+
+    pixman_box32_t box = { b->x, b->y, b->x + b->width, b->y + b->height };
+    if (!pixman_region32_not_empty(&clip) ||
+        pixman_region32_contains_rectangle(&clip, &box) == PIXMAN_REGION_OUT) {
+      item->culled = true;
+      output->stats.culledSurfaces++;
+      continue;
+    }
+
+    pixman_region32_clear(&opaque);
+    itemOpaqueRegion(item, &opaque);
+    pixman_region32_subtract(&clip, &clip, &opaque);
+  }
+
+  pixman_region32_fini(&opaque);
+  pixman_region32_fini(&clip);
+
+  for (int i = 0; i < count; i++) {
+    if (!items[i].culled) {
+      pixman_region32_init(&items[i].opaque);
+      splitItem(&items[i], &items[i].opaque, &items[i].translucent);
+    }
+  }
+}
+
+/* Free what cullScene split, once the scene and its replay are drawn */
+static void releaseSplits(struct Output *output) {
+  struct RenderItem *items = output->renderList.data;
+  int count = output->renderList.size / sizeof(struct RenderItem);
+  for (int i = 0; i < count; i++) {
+    if (!items[i].culled) {
+      pixman_region32_fini(&items[i].opaque);
+      pixman_region32_fini(&items[i].translucent);
+    }
+  }
+}
+
+/* Draw the given surface-local region of an item, one sub-quad per rect */
+static void drawItemRegion(struct Output *output, struct RenderItem *item,
+                           pixman_region32_t *region) {
+  int num_rects = 0;
+  pixman_box32_t *rects = pixman_region32_rectangles(region, &num_rects);
+  if (num_rects == 0) {
+    return;
+  }
+
+  struct shader *shader;
+  if (output->overdrawPass) {
+    /* Count one layer per fragment instead of shading it */
+    shader = output->overdrawShader;
+    useShader(shader);
+    set4f(shader, U_COLOR, 1.0f / 255.0f, 0.0f, 0.0f, 0.0f);
+  } else {
+    /* Select shader based on texture target */
+    struct wlr_gles2_texture_attribs *attribs = &item->attribs;
+    shader = (attribs->target == GL_TEXTURE_EXTERNAL_OES) 
+      ? output->windowShaderExternal 
+      : output->windowShader;
+    useShader(shader);
+
+    /* Bind texture and render quad */
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(attribs->target, attribs->tex);
+    
+    /* Set texture parameters - important for external textures */
+    glTexParameteri(attribs->target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(attribs->target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(attribs->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(attribs->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+
+  float width = item->width;
+  float height = item->height;
+  for (int i = 0; i < num_rects; i++) {
+    /* Sub-rect in unit quad space, used for both position and uv */
+    float x = rects[i].x1 / width;
+    float y = rects[i].y1 / height;
+    float w = (rects[i].x2 - rects[i].x1) / width;
+    float h = (rects[i].y2 - rects[i].y1) / height;
+
+    mat4 model;
+    glm_mat4_copy(item->model, model);
+    glm_translate(model, (vec3){x, y, 0});
+    glm_scale(model, (vec3){w, h, 1});
+
+    set4fv(shader, U_MODEL, 1, GL_FALSE, (float*)model);
+    set4f(shader, U_TEX_RECT, x, y, w, h);
+    drawMesh(output->quadMesh);
+    if (!output->overdrawPass) {
+      output->stats.drawCalls++;
+      /* The unit quad's area in buffer pixels, scale and rotation included */
+      output->stats.pixelsShaded +=
+        (uint64_t)fabsf(model[0][0] * model[1][1] - model[1][0] * model[0][1]);
+    }
+  }
+}
+
+/* Split an item into surface-local opaque and translucent regions. Buffers
+ * without alpha are opaque as a whole; overly fragmented splits fall back
+ * to one blended quad. */
+static void splitItem(struct RenderItem *item, pixman_region32_t *opaque,
+                      pixman_region32_t *translucent) {
+  int width = item->width;
+  int height = item->height;
+
+  itemSurfaceOpaque(item, opaque);
+  pixman_region32_init_rect(translucent, 0, 0, width, height);
+  pixman_region32_subtract(translucent, translucent, opaque);
+
+  if (pixman_region32_n_rects(opaque) + pixman_region32_n_rects(translucent) > MAX_SPLIT_RECTS) {
+    pixman_region32_clear(opaque);
+    pixman_region32_fini(translucent);
+    pixman_region32_init_rect(translucent, 0, 0, width, height);
+  }
+}
+
+static void drawItemPart(struct Output *output, struct RenderItem *item, bool opaquePart) {
+  if (output->overdrawPass) {
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    drawItemRegion(output, item, opaquePart ? &item->opaque : &item->translucent);
+  } else if (opaquePart) {
+    glDisable(GL_BLEND);
+    drawItemRegion(output, item, &item->opaque);
+  } else {
+    /* View caches hold premultiplied color */
+    glEnable(GL_BLEND);
+    glBlendFunc(item->cachedView ? GL_ONE : GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    drawItemRegion(output, item, &item->translucent);
+  }
+}
+
+static void frameDoneIter(struct wlr_surface *surface, int x, int y, void *data) {
+  wlr_surface_send_frame_done(surface, data);
+}
+
+static void presentedIter(struct wlr_surface *surface, int x, int y, void *data) {
+  wlr_presentation_surface_textured_on_output(surface, data);
+}
+
+struct ViewOpaqueContext {
+  struct SceneNode *node;
+  pixman_region32_t *covered;
+};
+
+/* Layout area an unrotated surface covers with opaque pixels */
+static void viewOpaqueIter(struct wlr_surface *surface, int x, int y, void *data) {
+  struct ViewOpaqueContext *ctx = data;
+  struct wlr_texture *texture = wlr_surface_get_texture(surface);
+  if (!texture) {
+    return;
+  }
+
+  pixman_region32_t opaque;
   struct wlr_gles2_texture_attribs attribs;
   wlr_gles2_texture_get_attribs(texture, &attribs);
+  if (!attribs.has_alpha) {
+    pixman_region32_init_rect(&opaque, 0, 0, surface->current.width, surface->current.height);
+  } else {
+    pixman_region32_init(&opaque);
+    pixman_region32_intersect_rect(&opaque, &surface->opaque_region,
+                                   0, 0, surface->current.width, surface->current.height);
+  }
 
-  struct shader *shader = (attribs.target == GL_TEXTURE_EXTERNAL_OES) 
-    ? ctx->output->windowShaderExternal 
-    : ctx->output->windowShader;
-  useShader(shader);
+  int num_rects = 0;
+  pixman_box32_t *rects = pixman_region32_rectangles(&opaque, &num_rects);
+  for (int i = 0; i < num_rects; i++) {
+    struct wlr_box local = {
+      x + rects[i].x1, y + rects[i].y1, rects[i].x2 - rects[i].x1, rects[i].y2 - rects[i].y1,
+    };
+    struct wlr_box box;
+    sceneNodeToLayout(ctx->node, &local, 0, &box);
+    pixman_region32_union_rect(ctx->covered, ctx->covered, box.x, box.y, box.width, box.height);
+  }
+  pixman_region32_fini(&opaque);
+}
 
-  mat4 proj = GLM_MAT4_IDENTITY_INIT;
-  glm_ortho(0, ctx->output->wlr_output->width, 0, ctx->output->wlr_output->height, -10.0f, 10.0f, proj);
-  set4fv(shader, "projection", 1, GL_FALSE, (float*)proj);
-  
-  mat4 view = GLM_MAT4_IDENTITY_INIT;
-  set4fv(shader, "view", 1, GL_FALSE, (float*)view);
+/* Output showing the largest part of a view, which paces its callbacks */
+struct Output *viewPrimaryOutput(struct View *view) {
+  struct SceneNode *node = viewNode(view);
+  if (!node->visible) {
+    return NULL;
+  }
 
-  mat4 model = GLM_MAT4_IDENTITY_INIT;
-  float surface_x = ctx->x + x;
-  float surface_y = ctx->y + y;
-  glm_translate(model, (vec3){surface_x, surface_y, ctx->depth});
-  set4fv(shader, "model", 1, GL_FALSE, (float*)model);
+  struct Output *primary = NULL, *output;
+  int best = 0;
+  wl_list_for_each(output, &view->server->outputs, link) {
+    struct wlr_box box, clip;
+    wlr_output_layout_get_box(view->server->outputLayout, output->wlr_output, &box);
+    if (wlr_box_intersection(&clip, &node->bounds, &box) && clip.width * clip.height > best) {
+      best = clip.width * clip.height;
+      primary = output;
+    }
+  }
+  return primary;
+}
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(attribs.target, attribs.tex);
-  
-  glTexParameteri(attribs.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(attribs.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(attribs.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(attribs.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  
-  glUniform1i(glGetUniformLocation(shader->ID, "s_texture"), 0);
+/* Get a frame from the output that paces the view, so a callback-only
+ * commit with no damage is answered too */
+void scheduleViewFrame(struct View *view) {
+  struct Output *output = viewPrimaryOutput(view);
+  if (output) {
+    wlr_output_schedule_frame(output->wlr_output);
+  }
+}
 
-  GLfloat vVertices[] = {
-    0,  0, 0.0f,    0.0f,  0.0f,
-    0, height, 0.0f, 0.0f,  1.0f,
-    width, height, 0.0f, 1.0f,  1.0f,
-    width,  0, 0.0f, 1.0f,  0.0f
-  };
-  GLushort indices[] = { 0, 1, 2, 0, 2, 3 };
+static void pendingCallbackIter(struct wlr_surface *surface, int x, int y, void *data) {
+  if (!wl_list_empty(&surface->current.frame_callback_list)) {
+    *(bool *)data = true;
+  }
+}
+
+static bool viewWaitsForFrame(struct View *view) {
+  bool waiting = false;
+  wlr_xdg_surface_for_each_surface(view->xdg, pendingCallbackIter, &waiting);
+  return waiting;
+}
 
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), vVertices);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), &vVertices[3]);
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
+static int throttledFrameCallbacks(void *data);
 
-  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, indices);
+/* Only armed while a throttled view waits on a callback, so an idle
+ * desktop does not wake up for it */
+static void armFrameThrottle(struct DeskServer *server) {
+  if (server->frameThrottleArmed) {
+    return;
+  }
+  if (!server->frameThrottleTimer) {
+    server->frameThrottleTimer = wl_event_loop_add_timer(
+      wl_display_get_event_loop(server->display), throttledFrameCallbacks, server);
+  }
+  wl_event_source_timer_update(server->frameThrottleTimer, 1000 / FRAME_THROTTLE_HZ);
+  server->frameThrottleArmed = true;
+}
 
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
+/* Callbacks hidden views were held back from, when no output frame came
+ * along to send them */
+static int throttledFrameCallbacks(void *data) {
+  struct DeskServer *server = data;
+  server->frameThrottleArmed = false;
 
-frame_done:
   struct timespec now;
   clock_gettime(CLOCK_MONOTONIC, &now);
-  wlr_surface_send_frame_done(surface, &now);
+  int64_t nowNs = timespecToNs(&now);
+
+  struct View *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (!view->frameThrottled) {
+      continue;
+    }
+    if (!view->xdg || !view->xdg->surface || !viewWaitsForFrame(view)) {
+      view->frameThrottled = false;
+      continue;
+    }
+    if (nowNs - view->lastFrameDoneNs < 1000000000 / FRAME_THROTTLE_HZ) {
+      armFrameThrottle(server);
+      continue;
+    }
+    view->frameThrottled = false;
+    view->lastFrameDoneNs = nowNs;
+    wlr_xdg_surface_for_each_surface(view->xdg, frameDoneIter, &now);
+  }
+  return 0;
 }
 
-static void renderLayer(struct Output *output, struct wl_list *layer_list, float *depth) {
-  struct LayerSurface *ls;
-  wl_list_for_each(ls, layer_list, link) {
-    if (!ls->mapped || !ls->layer_surface->surface->mapped) {
+/* The one place frame callbacks are sent, once per frame of each output,
+ * whatever was redrawn. Layer surfaces get one every frame of their
+ * output. A view gets one per frame of its primary output while any of it
+ * is left uncovered by opaque views above; covered views, and views on no
+ * output at all (paced by the first output), only FRAME_THROTTLE_HZ times
+ * a second. What that holds back is sent by the throttle timer if no
+ * frame comes first. */
+static void sendFrameCallbacks(struct Output *output) {
+  struct DeskServer *server = output->server;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t nowNs = timespecToNs(&now);
+  bool pacesOffscreen = server->outputs.next == &output->link;
+
+  for (int layer = 0; layer < 4; layer++) {
+    struct LayerSurface *ls;
+    wl_list_for_each(ls, &output->layers[layer], link) {
+      if (ls->mapped) {
+        wlr_layer_surface_v1_for_each_surface(ls->layer_surface, frameDoneIter, &now);
+      }
+    }
+  }
+
+  /* Front to back, gathering what opaque views above cover */
+  pixman_region32_t covered;
+  pixman_region32_init(&covered);
+  struct View *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (!view->xdg || !view->xdg->surface) {
       continue;
     }
 
-    struct LayerRenderContext ctx = {
-      .output = output,
-      .x = ls->x,
-      .y = ls->y,
-      .depth = *depth,
+    struct SceneNode *node = viewNode(view);
+    struct Output *primary = viewPrimaryOutput(view);
+    pixman_box32_t bounds = {
+      node->bounds.x, node->bounds.y,
+      node->bounds.x + node->bounds.width, node->bounds.y + node->bounds.height,
     };
+    bool hidden = !primary ||
+      pixman_region32_contains_rectangle(&covered, &bounds) == PIXMAN_REGION_IN;
+    if (node->visible && node->rot == 0.0f) {
+      struct ViewOpaqueContext ctx = { .node = node, .covered = &covered };
+      wlr_xdg_surface_for_each_surface(view->xdg, viewOpaqueIter, &ctx);
+    }
 
-    wlr_surface_for_each_surface(ls->layer_surface->surface, 
-                                  renderLayerSurfaceIter, &ctx);
-    (*depth)++;
+    if (primary != output && !(primary == NULL && pacesOffscreen)) {
+      continue;
+    }
+    if (hidden && nowNs - view->lastFrameDoneNs < 1000000000 / FRAME_THROTTLE_HZ) {
+      if (viewWaitsForFrame(view)) {
+        view->frameThrottled = true;
+        armFrameThrottle(server);
+      }
+      continue;
+    }
+    view->frameThrottled = false;
+    view->lastFrameDoneNs = nowNs;
+    wlr_xdg_surface_for_each_surface(view->xdg, frameDoneIter, &now);
+  }
+  pixman_region32_fini(&covered);
+}
+
+/* Draw every visible item. With a depth buffer, opaque parts go
+ * front-to-back without blending so early-z rejects what they hide, then
+ * translucent parts go back-to-front on top. Without one, both parts are
+ * painted back-to-front. */
+static void drawScene(struct Output *output, bool depth) {
+  struct RenderItem *items = output->renderList.data;
+  int count = output->renderList.size / sizeof(struct RenderItem);
+
+  if (depth) {
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    for (int i = count - 1; i >= 0; i--) {
+      if (!items[i].culled) {
+        drawItemPart(output, &items[i], true);
+      }
+    }
+
+    glDepthMask(GL_FALSE);
+    for (int i = 0; i < count; i++) {
+      if (!items[i].culled) {
+        drawItemPart(output, &items[i], false);
+      }
+    }
+    glDepthMask(GL_TRUE);
+    glDisable(GL_DEPTH_TEST);
+  } else {
+    for (int i = 0; i < count; i++) {
+      if (!items[i].culled) {
+        drawItemPart(output, &items[i], true);
+        drawItemPart(output, &items[i], false);
+      }
+    }
+  }
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+/* Draw the scene. Surfaces that made it on screen get their pending
+ * presentation feedback tied to this output's next present event. */
+static void renderScene(struct Output *output, bool depth) {
+  struct RenderItem *items = output->renderList.data;
+  int count = output->renderList.size / sizeof(struct RenderItem);
+
+  drawScene(output, depth);
+
+  for (int i = 0; i < count; i++) {
+    if (!items[i].culled) {
+      output->stats.surfacesDrawn++;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    if (items[i].culled) {
+      continue;
+    }
+    if (items[i].cachedView) {
+      wlr_xdg_surface_for_each_surface(items[i].cachedView->xdg, presentedIter,
+                                       output->wlr_output);
+    } else {
+      wlr_presentation_surface_textured_on_output(items[i].surface, output->wlr_output);
+    }
   }
 }
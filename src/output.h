@@ -4,9 +4,20 @@
 #include "events.h"
 #include "config.h"
 #include "view.h"
+#include "mesh.h"
+#include "damage.h"
+#include "histogram.h"
 #include <time.h>
 #include <math.h>
 
+/* A swapchain buffer and the frame it was last painted in */
+struct DamageBuffer {
+  struct Output *output;
+  struct wlr_buffer *buffer;
+  uint64_t frame;               // 0 when its contents are unknown
+  struct wl_listener destroy;
+};
+
 typedef struct Output {
   struct DeskServer *server;
   struct wl_list link;
@@ -14,6 +25,8 @@ typedef struct Output {
   struct wl_listener frame;
   struct wl_listener present;
   struct wl_listener requestState;
+  struct wl_listener damage;
+  struct wl_listener needsFrame;
   struct wl_listener destroy;
 
   struct wl_list layers[4];
@@ -22,43 +35,152 @@ typedef struct Output {
   struct shader *windowShaderExternal;
   struct shader *cursorShader;
   struct shader *debugShader;
+  struct shader *overdrawShader;
+  struct shader *heatShader;
+  struct mesh *quadMesh;
+  struct mesh *screenMesh;
+  GLuint frameUBO;
+  GLuint cacheUBO;
+  /* Layout coordinates -> this output's buffer pixels: origin, scale and
+   * transform. Render items are baked through it when collected. */
+  mat4 layoutToBuffer;
   struct wlr_render_pass *pass;
   bool shader_initialized;
   bool frame_pending;
+  bool scanout;
+
+  /* Adaptive sync and tearing policy, and whether the backend refused
+   * what the policy last asked for */
+  bool vrrWanted, vrrRefused;
+  bool tearingWanted, tearingRefused;
+
+  /* Last presentation, to predict when the next frame is seen */
+  struct timespec lastPresent;
+  int refreshNs;                // 0 when the refresh rate is unknown
+
+  /* Late-latched frames: rendering is held back until it only just makes
+   * the predicted vblank, going by how long recent frames took */
+  struct wl_event_source *frameTimer;
+  bool frameDelayed;
+  bool renderQueued;            // frame came in, rendered at the end of the loop pass
+  int64_t renderQueuedNs;
+  int64_t targetVblankNs;       // vblank the frame in flight aims for, 0 if none
+  int64_t renderTimes[RENDER_TIME_HISTORY];
+  int renderTimeHead;
+  struct wlr_render_timer *renderTimer;
+  bool renderTimerPending;      // the last frame's pass was timed
+  int64_t pendingCpuNs;         // CPU time of the last frame, -1 once recorded
+  int missedFrames;
+
+  /* Input-to-photon latency: the newest input this output has to show,
+   * the input the frame in flight shows, and how long inputs took from
+   * arrival to presentation, overall and since the last periodic log */
+  int64_t pendingInputNs;       // 0 when no input is waiting to be shown
+  int64_t inflightInputNs;
+  struct histogram latency;
+  struct histogram latencyWindow;
+  int64_t lastLatencyLogNs;
 
   GLuint uiTexture;
-  GLuint screenTexture;
+
+  /* Last composited scene without the cursor, for cursor-only frames and
+   * for the lens to sample from */
+  GLuint sceneFBO;
+  GLuint sceneTexture;
+  int sceneWidth, sceneHeight;
+  /* Damage other than cursor damage is pending */
+  bool sceneDirty;
+
+  /* Depth/stencil attachment shared by every swapchain buffer */
+  GLuint depthStencil;
+  int depthStencilWidth, depthStencilHeight;
+
+  /* Per-frame counters, reset at the start of every frame */
+  struct {
+    int drawCalls;
+    int damageRects;            // after simplification
+    int rawDamageRects;
+    enum damageStrategy strategy;
+    int culledSurfaces;
+    int surfacesDrawn;
+    uint64_t pixelsShaded;      // quad area in buffer pixels, before depth and stencil rejection
+  } stats;
+
+  /* Damage debugging: per-pixel overdraw counts from replaying the scene
+   * with additive blending, and the damage of the last frames */
+  GLuint overdrawFBO;
+  GLuint overdrawTexture;
+  GLuint overdrawDepth;
+  int overdrawWidth, overdrawHeight;
+  bool overdrawPass;
+  pixman_region32_t debugHistory[DEBUG_DAMAGE_FRAMES];
+  int debugHistoryHead;
+
+  /* Picks how this frame's damage is shaped before it is rendered */
+  struct damageCostModel costModel;
+
+  /* struct RenderItem, rebuilt every frame */
+  struct wl_array renderList;
 
   struct wlr_damage_ring damage_ring;
   bool needs_full_damage;
   
-  /* Track previous frame damage for double buffering */
-  pixman_region32_t prev_damage;
+  /* Damage of each of the last frames, indexed by frame number, so a
+   * buffer of age N is brought up to date with the last N of them */
+  pixman_region32_t damageHistory[DAMAGE_HISTORY];
+  uint64_t frameCount;
+  struct DamageBuffer damageBuffers[DAMAGE_HISTORY];
   } Output;
 
 struct Output *mkOutput(struct DeskServer *,struct wlr_output*);
 void destroyOutput(struct Output *);
+/* damageOutputWhole works in buffer pixels; the others take layout
+ * coordinates and drop whatever falls outside the output */
 void damageOutputWhole(struct Output *);
 void damageOutputBox(struct Output *, struct wlr_box *box);
+void damageOutputCursor(struct Output *, struct wlr_box *box);
+void damageOutputRegion(struct Output *, pixman_region32_t *region);
+/* An input event that arrived at ns is first seen in this output's next frame */
+void noteOutputInput(struct Output *, int64_t ns);
+void logOutputLatency(struct Output *);
+bool outputsQueued(struct DeskServer *);
+void renderQueuedOutputs(struct DeskServer *);
 
 LISTNER(frame, void, Output);
 LISTNER(present, struct wlr_output_event_present, Output);
 LISTNER(requestState, struct wlr_output_event_request_state, Output);
+LISTNER(damage, struct wlr_output_event_damage, Output);
+LISTNER(needsFrame, void, Output);
 LISTNER(destroy, struct wlr_output, Output);
 
 struct RenderContext {
   struct Output *output;
   struct View *view;
-  int width, height, offsetX, offsetY;
-  float depth;
-  cairo_t *uiCtx;
 };
 
 struct LayerRenderContext {
   struct Output *output;
-  int x, y;
-  float depth;
+  struct SceneNode *node;
+};
+
+/* A textured surface queued for drawing this frame */
+struct RenderItem {
+  struct wlr_surface *surface;  // NULL when drawing a view cache
+  struct View *cachedView;      // view whose offscreen cache this item draws
+  struct wlr_gles2_texture_attribs attribs;
+  int width, height;            // texture size in surface-local pixels
+  mat4 model;                   // unit quad -> buffer pixels
+  float rot;
+  struct wlr_box bounds;        // buffer-space bounding box of the quad
+  bool culled;
+  /* Surface-local parts drawn without and with blending, split once by
+   * cullScene for every item left visible */
+  pixman_region32_t opaque, translucent;
 };
 
-void renderSurfaceIter(struct wlr_surface *, int, int, void *);
-void renderLayerSurfaceIter(struct wlr_surface *, int, int, void *);
+void collectSurfaceIter(struct wlr_surface *, int, int, void *);
+void releaseViewCache(struct View *);
+void renderUI(struct Output *);
+void scheduleViewFrame(struct View *);
+struct Output *viewPrimaryOutput(struct View *);
+void collectLayerSurfaceIter(struct wlr_surface *, int, int, void *);
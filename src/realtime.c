@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include "realtime.h"
+#include "config.h"
+#include "macro.h"
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+/* Round robin at a modest priority: ahead of every normal task, behind
+ * the kernel's own threads. Reset on fork, so spawned clients do not run
+ * realtime. Falls back to the best nice value RLIMIT_NICE allows. */
+static void raisePriority(void) {
+  struct sched_param param = { .sched_priority = REALTIME_PRIORITY };
+  if (sched_setscheduler(0, SCHED_RR | SCHED_RESET_ON_FORK, &param) == 0) {
+    LOG("Realtime: SCHED_RR priority %d", REALTIME_PRIORITY);
+    return;
+  }
+  LOG("Realtime: SCHED_RR refused (%s), trying nice %d", strerror(errno), REALTIME_NICE);
+
+  for (int nice = REALTIME_NICE; nice < 0; nice++) {
+    if (setpriority(PRIO_PROCESS, 0, nice) == 0) {
+      LOG("Realtime: running at nice %d", nice);
+      return;
+    }
+  }
+  LOG("Realtime: could not raise priority (%s), running as a normal task", strerror(errno));
+}
+
+/* Lock what is mapped now, and what gets mapped later only when the lock
+ * limit cannot make those mappings fail */
+static void lockMemory(void) {
+  struct rlimit limit;
+  bool unlimited = geteuid() == 0 ||
+    (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY);
+
+  int flags = MCL_CURRENT | (unlimited ? MCL_FUTURE : 0);
+  if (mlockall(flags) != 0) {
+    LOG("Realtime: mlockall failed (%s), memory may be paged out", strerror(errno));
+    return;
+  }
+  LOG("Realtime: memory locked%s", unlimited ? "" : ", new mappings are not (RLIMIT_MEMLOCK)");
+}
+
+static void pinCpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    LOG("Realtime: could not pin to CPU %d (%s)", cpu, strerror(errno));
+    return;
+  }
+  LOG("Realtime: pinned to CPU %d", cpu);
+}
+
+void enterRealtime(const struct realtimeOptions *options) {
+  if (options->enabled) {
+    raisePriority();
+    lockMemory();
+  }
+  if (options->cpu >= 0) {
+    pinCpu(options->cpu);
+  }
+}
+
+void leaveRealtime(void) {
+  /* Lowering priority and widening affinity are always allowed */
+  setpriority(PRIO_PROCESS, 0, 0);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int i = 0; i < CPU_SETSIZE; i++) {
+    CPU_SET(i, &set);
+  }
+  sched_setaffinity(0, sizeof(set), &set);
+}
+
+static void armJitterProbe(struct jitterProbe *probe) {
+  probe->deadlineNs = monotonicNs() + (int64_t)JITTER_PERIOD_MS * 1000000;
+  wl_event_source_timer_update(probe->timer, JITTER_PERIOD_MS);
+}
+
+static int jitterWakeup(void *data) {
+  struct jitterProbe *probe = data;
+  int64_t now = monotonicNs();
+  int64_t late = (now - probe->deadlineNs) / 1000;
+  histogramAdd(&probe->lateness, late);
+  histogramAdd(&probe->window, late);
+
+  if (now - probe->lastLogNs >= (int64_t)LATENCY_LOG_INTERVAL * 1000000000) {
+    char label[64];
+    snprintf(label, sizeof(label), "Timer wakeup lateness, last %ds", LATENCY_LOG_INTERVAL);
+    histogramLog(&probe->window, label);
+    histogramReset(&probe->window);
+    probe->lastLogNs = now;
+  }
+
+  armJitterProbe(probe);
+  return 0;
+}
+
+struct jitterProbe *startJitterProbe(struct wl_event_loop *loop) {
+  struct jitterProbe *probe = calloc(1, sizeof(struct jitterProbe));
+  ASSERTN(probe);
+  probe->timer = wl_event_loop_add_timer(loop, jitterWakeup, probe);
+  probe->lastLogNs = monotonicNs();
+  armJitterProbe(probe);
+  LOG("Jitter probe: waking every %d ms", JITTER_PERIOD_MS);
+  return probe;
+}
+
+void stopJitterProbe(struct jitterProbe *probe) {
+  if (!probe) {
+    return;
+  }
+  wl_event_source_remove(probe->timer);
+  free(probe);
+}
+
+void logJitter(struct jitterProbe *probe) {
+  histogramLog(&probe->lateness, "Timer wakeup lateness");
+}
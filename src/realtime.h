@@ -0,0 +1,27 @@
+#pragma once
+#include "imports.h"
+#include "histogram.h"
+
+/* Opt-in scheduling for the compositor thread, set from the command line */
+struct realtimeOptions {
+  bool enabled;                 // SCHED_RR, or a raised nice value when refused
+  int cpu;                      // CPU to pin to, -1 for none
+  bool jitter;                  // measure timer wakeup lateness
+};
+
+/* Wakes up on a fixed period and records how late each wakeup was, which
+ * is how long the event loop keeps ready work waiting */
+struct jitterProbe {
+  struct wl_event_source *timer;
+  int64_t deadlineNs;
+  struct histogram lateness;
+  struct histogram window;      // since the last periodic log
+  int64_t lastLogNs;
+};
+
+void enterRealtime(const struct realtimeOptions *);
+// For forked children, so clients do not inherit the compositor's priority or CPU
+void leaveRealtime(void);
+struct jitterProbe *startJitterProbe(struct wl_event_loop *);
+void stopJitterProbe(struct jitterProbe *);
+void logJitter(struct jitterProbe *);
@@ -0,0 +1,186 @@
+#include "scene.h"
+#include "server.h"
+#include "view.h"
+#include "layer.h"
+#include <math.h>
+#include <string.h>
+
+void initSceneNode(struct SceneNode *node, enum SceneNodeType type) {
+  memset(node, 0, sizeof(*node));
+  node->type = type;
+  node->dirty = true;
+  glm_mat4_identity(node->transform);
+  glm_mat4_identity(node->inverse);
+  pixman_region32_init(&node->region);
+}
+
+void finishSceneNode(struct SceneNode *node) {
+  pixman_region32_fini(&node->region);
+}
+
+/* Layout-space bounding box of a node-local box, grown by pad */
+void sceneNodeToLayout(struct SceneNode *node, struct wlr_box *local, int pad, struct wlr_box *out) {
+  float corners[4][2] = {
+    { local->x, local->y },
+    { local->x + local->width, local->y },
+    { local->x, local->y + local->height },
+    { local->x + local->width, local->y + local->height },
+  };
+  float min_x = INFINITY, min_y = INFINITY, max_x = -INFINITY, max_y = -INFINITY;
+  for (int i = 0; i < 4; i++) {
+    vec3 p;
+    glm_mat4_mulv3(node->transform, (vec3){ corners[i][0], corners[i][1], 0 }, 1.0f, p);
+    if (p[0] < min_x) min_x = p[0];
+    if (p[0] > max_x) max_x = p[0];
+    if (p[1] < min_y) min_y = p[1];
+    if (p[1] > max_y) max_y = p[1];
+  }
+  out->x = (int)floorf(min_x) - pad;
+  out->y = (int)floorf(min_y) - pad;
+  out->width = (int)ceilf(max_x) - (int)floorf(min_x) + pad * 2;
+  out->height = (int)ceilf(max_y) - (int)floorf(min_y) + pad * 2;
+}
+
+/* Horizontal extent of the transformed box within the band [y0, y1] */
+static bool bandSpan(vec3 corners[4], float y0, float y1, float *x0, float *x1) {
+  *x0 = INFINITY;
+  *x1 = -INFINITY;
+  for (int i = 0; i < 4; i++) {
+    float *p = corners[i];
+    float *q = corners[(i + 1) % 4];
+    float lo = fmaxf(fminf(p[1], q[1]), y0);
+    float hi = fminf(fmaxf(p[1], q[1]), y1);
+    if (lo > hi) {
+      continue;
+    }
+    /* Clip the edge to the band; its ends bound the span */
+    float ys[2] = { lo, hi };
+    for (int j = 0; j < 2; j++) {
+      float t = q[1] != p[1] ? (ys[j] - p[1]) / (q[1] - p[1]) : 0.0f;
+      float x = p[0] + (q[0] - p[0]) * t;
+      *x0 = fminf(*x0, x);
+      *x1 = fmaxf(*x1, x);
+    }
+  }
+  return *x0 <= *x1;
+}
+
+/* Bounds, and a region of horizontal bands tracing the transformed box so
+ * that rotated nodes damage close to the pixels they cover */
+static void updateBounds(struct SceneNode *node, struct wlr_box *local, int pad) {
+  sceneNodeToLayout(node, local, pad, &node->bounds);
+
+  struct wlr_box *b = &node->bounds;
+  pixman_region32_fini(&node->region);
+  if (node->rot == 0.0f || wlr_box_empty(local)) {
+    pixman_region32_init_rect(&node->region, b->x, b->y, b->width, b->height);
+    return;
+  }
+  pixman_region32_init(&node->region);
+
+  vec3 corners[4];
+  float xs[4] = { local->x, local->x + local->width, local->x + local->width, local->x };
+  float ys[4] = { local->y, local->y, local->y + local->height, local->y + local->height };
+  for (int i = 0; i < 4; i++) {
+    glm_mat4_mulv3(node->transform, (vec3){ xs[i], ys[i], 0 }, 1.0f, corners[i]);
+  }
+
+  int top = b->y + pad;
+  int bottom = b->y + b->height - pad;
+  for (int y = top; y < bottom; y += SCENE_BAND_HEIGHT) {
+    int band_bottom = y + SCENE_BAND_HEIGHT < bottom ? y + SCENE_BAND_HEIGHT : bottom;
+    float x0, x1;
+    if (!bandSpan(corners, y, band_bottom, &x0, &x1)) {
+      continue;
+    }
+    int rx = (int)floorf(x0) - pad;
+    pixman_region32_union_rect(&node->region, &node->region, rx, y - pad,
+                               (int)ceilf(x1) + pad - rx, band_bottom - y + pad * 2);
+  }
+}
+
+struct SceneNode *viewNode(struct View *view) {
+  struct SceneNode *node = &view->node;
+  if (!node->dirty) {
+    return node;
+  }
+  node->dirty = false;
+
+  struct wlr_surface *surface = view->xdg ? view->xdg->surface : NULL;
+  node->visible = surface && surface->mapped;
+  if (!surface) {
+    node->extents = (struct wlr_box){0};
+    node->bounds = (struct wlr_box){0};
+    pixman_region32_clear(&node->region);
+    return node;
+  }
+  wlr_surface_get_extents(surface, &node->extents);
+
+  /* Rotate about the center of the main surface extents */
+  float pivot_x = view->x + node->extents.width / 2.0f;
+  float pivot_y = view->y + node->extents.height / 2.0f;
+
+  node->rot = view->rot;
+  glm_mat4_identity(node->transform);
+  glm_translate(node->transform, (vec3){ pivot_x, pivot_y, 0 });
+  if (view->rot != 0.0f) {
+    glm_rotate_z(node->transform, view->rot, node->transform);
+  }
+  glm_translate(node->transform, (vec3){ view->x - pivot_x, view->y - pivot_y, 0 });
+  glm_mat4_inv(node->transform, node->inverse);
+
+  /* A pixel of slack for the rasterizer's antialiasing of rotated edges */
+  updateBounds(node, &node->extents, 1);
+  return node;
+}
+
+struct SceneNode *layerNode(struct LayerSurface *ls) {
+  struct SceneNode *node = &ls->node;
+  if (!node->dirty) {
+    return node;
+  }
+  node->dirty = false;
+
+  struct wlr_surface *surface = ls->layer_surface->surface;
+  node->visible = ls->mapped && surface && surface->mapped;
+  if (!surface) {
+    node->extents = (struct wlr_box){0};
+    node->bounds = (struct wlr_box){0};
+    pixman_region32_clear(&node->region);
+    return node;
+  }
+  wlr_surface_get_extents(surface, &node->extents);
+
+  glm_mat4_identity(node->transform);
+  glm_translate(node->transform, (vec3){ ls->x, ls->y, 0 });
+  glm_mat4_inv(node->transform, node->inverse);
+  updateBounds(node, &node->extents, 0);
+  return node;
+}
+
+/* The node covers what the cursor draws into the scene: the lens footprint
+ * with a pixel of antialiasing on each side */
+struct SceneNode *cursorNode(struct DeskServer *server) {
+  struct SceneNode *node = &server->cursorNode;
+  if (!node->dirty) {
+    return node;
+  }
+  node->dirty = false;
+
+  node->visible = server->lensCursor;
+  int radius = CURSOR_LENS_RADIUS + 1;
+  node->extents = (struct wlr_box){ -radius, -radius, radius * 2 + 1, radius * 2 + 1 };
+
+  glm_mat4_identity(node->transform);
+  glm_translate(node->transform, (vec3){ (int)server->cursor->x, (int)server->cursor->y, 0 });
+  glm_mat4_inv(node->transform, node->inverse);
+  updateBounds(node, &node->extents, 0);
+  return node;
+}
+
+void sceneNodeToLocal(struct SceneNode *node, double lx, double ly, double *x, double *y) {
+  vec3 p;
+  glm_mat4_mulv3(node->inverse, (vec3){ lx, ly, 0 }, 1.0f, p);
+  *x = p[0];
+  *y = p[1];
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "imports.h"
+
+struct View;
+struct LayerSurface;
+struct DeskServer;
+
+/*
+  Retained placement of whatever is drawn, damaged or hit-tested: one node
+  per view, layer surface and for the cursor. Subsurfaces and popups sit in
+  their root's node, positioned by wlroots' own surface tree. A node is
+  recomputed only after something marks it dirty.
+ */
+enum SceneNodeType {
+  SCENE_NODE_VIEW,
+  SCENE_NODE_LAYER,
+  SCENE_NODE_CURSOR,
+};
+
+struct SceneNode {
+  enum SceneNodeType type;
+  bool dirty;
+  bool visible;
+  float rot;
+  mat4 transform;           // node-local -> layout
+  mat4 inverse;             // layout -> node-local
+  struct wlr_box extents;   // node-local extents of the surface tree
+  struct wlr_box bounds;    // layout-space box covering the node
+  pixman_region32_t region; // bounds tightened to the rotated shape, for damage
+};
+
+void initSceneNode(struct SceneNode *, enum SceneNodeType);
+void finishSceneNode(struct SceneNode *);
+struct SceneNode *viewNode(struct View *);
+struct SceneNode *layerNode(struct LayerSurface *);
+struct SceneNode *cursorNode(struct DeskServer *);
+void sceneNodeToLocal(struct SceneNode *, double lx, double ly, double *x, double *y);
+void sceneNodeToLayout(struct SceneNode *, struct wlr_box *local, int pad, struct wlr_box *out);
@@ -2,67 +2,119 @@
 #include "layer.h"
 #include <math.h>
 
-static void getViewDamageBox(struct View *view, struct wlr_box *box);
-static void damageView(struct DeskServer *server, struct View *view);
+static void damageViewMove(struct DeskServer *server, struct View *view);
+static void processCursorMotion(struct DeskServer *server, uint32_t time);
+
+/* Wrap an angle difference into (-pi, pi] */
+static float wrapAngle(float angle) {
+  while (angle > M_PI) angle -= 2 * M_PI;
+  while (angle < -M_PI) angle += 2 * M_PI;
+  return angle;
+}
 
-/* Animation frame callback - updates smooth movement and rotation */
-static int animationFrame(void *data) {
-  struct DeskServer *server = (struct DeskServer *)data;
-  
+/* One fixed step of the damped springs pulling a view toward its target
+ * pose, semi-implicit Euler. Damping comes from the view's per-16 ms
+ * dampening factor, so the motion matches the old fixed-tick feel. */
+static void stepView(struct View *view, float h) {
+  float damping = -logf(view->dampening) * 60.0f;
+
+  view->vel_x += (ANIMATION_STIFFNESS * (view->target_x - view->x) - damping * view->vel_x) * h;
+  view->vel_y += (ANIMATION_STIFFNESS * (view->target_y - view->y) - damping * view->vel_y) * h;
+  view->x += view->vel_x * h;
+  view->y += view->vel_y * h;
+
+  float d_rot = wrapAngle(view->target_rot - view->rot);
+  view->rot_vel += (ANIMATION_STIFFNESS * d_rot - damping * view->rot_vel) * h;
+  view->rot += view->rot_vel * h;
+}
+
+/* Snap a view that has come to rest onto its target. Returns whether the
+ * pose changed. */
+static bool settleView(struct View *view) {
+  bool moved = false;
+  float dx = view->target_x - view->x;
+  float dy = view->target_y - view->y;
+  if (fabsf(view->vel_x) < ANIMATION_SETTLE_VELOCITY &&
+      fabsf(view->vel_y) < ANIMATION_SETTLE_VELOCITY &&
+      fabsf(dx) < ANIMATION_SNAP_DISTANCE && fabsf(dy) < ANIMATION_SNAP_DISTANCE) {
+    moved |= dx != 0 || dy != 0;
+    view->x = view->target_x;
+    view->y = view->target_y;
+    view->vel_x = view->vel_y = 0;
+  }
+
+  float d_rot = wrapAngle(view->target_rot - view->rot);
+  if (fabsf(view->rot_vel) < ANIMATION_SETTLE_ROT_VELOCITY && fabsf(d_rot) < ANIMATION_SNAP_ANGLE) {
+    moved |= d_rot != 0;
+    view->rot = view->target_rot;
+    view->rot_vel = 0;
+  }
+  return moved;
+}
+
+/* Start the animation clock if it was idle and get frames going. Called
+ * whenever something gives a view a new target. */
+void wakeAnimation(struct DeskServer *server) {
+  if (!server->animating) {
+    server->animating = true;
+    server->animationLag = 0;
+    clock_gettime(CLOCK_MONOTONIC, &server->animationTime);
+  }
+  scheduleRedraw(server);
+}
+
+/* Advance every view to `when`, the time the output's frame is expected on
+ * screen, in fixed steps, and damage what moved once. Outputs share the
+ * clock, so a frame whose time was already reached does nothing. Outputs
+ * keep asking for frames on presentation until every view has settled. */
+void animateViews(struct DeskServer *server, const struct timespec *when) {
+  if (!server->animating) {
+    return;
+  }
+
+  double dt = (when->tv_sec - server->animationTime.tv_sec) +
+    (when->tv_nsec - server->animationTime.tv_nsec) / 1e9;
+  if (dt <= 0) {
+    return;
+  }
+  server->animationTime = *when;
+  server->animationLag = fmin(server->animationLag + dt, ANIMATION_MAX_LAG);
+  int steps = (int)(server->animationLag * ANIMATION_STEP_HZ);
+  server->animationLag -= (double)steps / ANIMATION_STEP_HZ;
+
+  bool unsettled = false;
   struct View *view;
   wl_list_for_each(view, &server->views, link) {
     if (!view->xdg || !view->xdg->surface) continue;
-    
-    /* Update position with velocity - spring physics */
-    float dx = view->target_x - view->x;
-    float dy = view->target_y - view->y;
-    
-    /* Accelerate towards target */
-    float stiffness = 0.3f;
-    view->vel_x += dx * stiffness;
-    view->vel_y += dy * stiffness;
-    
-    /* Dampen velocity (friction) */
-    view->vel_x *= view->dampening;
-    view->vel_y *= view->dampening;
-    
-    /* Apply velocity */
-    if (fabs(view->vel_x) > 0.1f || fabs(view->vel_y) > 0.1f) {
-      damageView(server, view);
-      view->x += view->vel_x;
-      view->y += view->vel_y;
-      damageView(server, view);
-    } else if (fabs(dx) > 0.5f || fabs(dy) > 0.5f) {
-      damageView(server, view);
-      view->x = view->target_x;
-      view->y = view->target_y;
-      view->vel_x = view->vel_y = 0;
-      damageView(server, view);
+
+    /* Settle the node on the current pose, so its region is the "before" */
+    viewNode(view);
+
+    bool moved = false;
+    if (viewAnimating(view)) {
+      for (int i = 0; i < steps; i++) {
+        stepView(view, 1.0f / ANIMATION_STEP_HZ);
+      }
+      moved = steps > 0;
+      moved |= settleView(view);
     }
-    
-    /* Update rotation with velocity - spring physics */
-    float d_rot = view->target_rot - view->rot;
-    while (d_rot > M_PI) d_rot -= 2 * M_PI;
-    while (d_rot < -M_PI) d_rot += 2 * M_PI;
-    
-    view->rot_vel += d_rot * stiffness;
-    view->rot_vel *= view->dampening;
-    
-    if (fabs(view->rot_vel) > 0.001f) {
-      damageView(server, view);
-      view->rot += view->rot_vel;
-      damageView(server, view);
-    } else if (fabs(d_rot) > 0.01f) {
-      damageView(server, view);
-      view->rot = view->target_rot;
-      view->rot_vel = 0;
-      damageView(server, view);
+    if (view->fadeIn > 0) {
+      view->fadeIn -= dt / ANIMATION_FADE_IN;
+      moved = true;
+    }
+
+    /* One damage per frame: the union of the old and new poses */
+    if (moved) {
+      damageViewMove(server, view);
     }
+    unsettled |= viewAnimating(view) || view->fadeIn > 0;
   }
-  
-  /* Reschedule timer for next frame */
-  wl_event_source_timer_update(server->animation_timer, 16);
-  
+
+  server->animating = unsettled;
+}
+
+static int latencySignal(int signal, void *data) {
+  dumpLatency(data);
   return 0;
 }
 
@@ -73,8 +125,8 @@ struct DeskServer *newServer() {
   ASSERTN(server);
 
   server->display = wl_display_create();
-  ASSERTN(server->backend = wlr_backend_autocreate(
-            wl_display_get_event_loop(server->display), NULL));
+  initEventLoop(&server->loop, server->display);
+  ASSERTN(server->backend = wlr_backend_autocreate(server->loop.backend, NULL));
 
   ASSERTN(server->renderer = wlr_renderer_autocreate(server->backend));
 
@@ -85,6 +137,7 @@ struct DeskServer *newServer() {
 
   server->compositor = wlr_compositor_create(server->display, 5, server->renderer);
   wlr_subcompositor_create(server->display);
+  server->presentation = wlr_presentation_create(server->display, server->backend, 2);
   wlr_data_device_manager_create(server->display);
 
   ATTACH(DeskServer, server, server->compositor->events.new_surface, newSurface);
@@ -103,6 +156,9 @@ struct DeskServer *newServer() {
   server->layerShell = wlr_layer_shell_v1_create(server->display, 4);
   ATTACH(DeskServer, server, server->layerShell->events.new_surface, newLayerSurface);
 
+  server->tearingControl = wlr_tearing_control_manager_v1_create(server->display, 1);
+  server->contentType = wlr_content_type_manager_v1_create(server->display, 1);
+
   wl_list_init(&server->keyboards);
 
   server->cursor = wlr_cursor_create();
@@ -113,7 +169,14 @@ struct DeskServer *newServer() {
   ATTACH(DeskServer, server, server->cursor->events.axis, cursorAxis);
   ATTACH(DeskServer, server, server->backend->events.new_input, newInput);
 
+  /* Themed cursor images, loaded per output scale on demand */
+  server->cursorMgr = wlr_xcursor_manager_create(NULL, 24);
+  server->lensCursor = false;
+  initSceneNode(&server->cursorNode, SCENE_NODE_CURSOR);
+  wlr_cursor_set_xcursor(server->cursor, server->cursorMgr, "default");
+
   server->seat = wlr_seat_create(server->display, "seat0");
+  ATTACH(DeskServer, server, server->seat->events.request_set_cursor, requestCursor);
 
   ASSERTN(server->socket = wl_display_add_socket_auto(server->display));
 
@@ -121,6 +184,10 @@ struct DeskServer *newServer() {
 
   ATTACH(DeskServer, server, server->resize, resizeHandler);
 
+  /* kill -USR1 dumps the latency histograms without touching the session */
+  server->latencySignal = wl_event_loop_add_signal(
+    wl_display_get_event_loop(server->display), SIGUSR1, latencySignal, server);
+
   server->foo = 0;
   server->bar = 0;  
   server->x = 0;
@@ -132,8 +199,12 @@ struct DeskServer *newServer() {
   server->superPressed = false;
   server->moveMode = false;
   server->grabbed_view = NULL;
-  server->animation_timer = NULL;
+  server->animating = false;
   server->debugDamage = false;
+  server->realtime = (struct realtimeOptions){ .enabled = false, .cpu = -1, .jitter = false };
+  server->jitter = NULL;
+  server->frameThrottleTimer = NULL;
+  server->frameThrottleArmed = false;
 
   return server;
 }
@@ -142,20 +213,33 @@ void startServer(struct DeskServer *server) {
   wlr_log(WLR_INFO, "Running Wayland compositor on WAYLAND_DISPLAY=%s", server->socket);
   setenv("WAYLAND_DISPLAY", server->socket, true);
 
-  /* Start animation timer (~60 FPS) */
-  struct wl_event_loop *loop = wl_display_get_event_loop(server->display);
-  server->animation_timer = wl_event_loop_add_timer(loop, animationFrame, server);
-  wl_event_source_timer_update(server->animation_timer, 16);  // 16ms = ~60 FPS
-
   ASSERTN(wlr_backend_start(server->backend));
-  wl_display_run(server->display);
+
+  /* After startup, so what the backend and renderer mapped gets locked */
+  enterRealtime(&server->realtime);
+  if (server->realtime.jitter) {
+    server->jitter = startJitterProbe(wl_display_get_event_loop(server->display));
+  }
+  runEventLoop(server);
+}
+
+void stopServer(struct DeskServer *server) {
+  server->loop.running = false;
+  wl_display_terminate(server->display);
 }
 
 void destroyServer(struct DeskServer *server) {
   ASSERTN(server);
 
+  wl_event_source_remove(server->latencySignal);
+  stopJitterProbe(server->jitter);
+  if (server->frameThrottleTimer) {
+    wl_event_source_remove(server->frameThrottleTimer);
+  }
+  wlr_xcursor_manager_destroy(server->cursorMgr);
   wlr_backend_destroy(server->backend);
   wl_display_destroy(server->display);
+  finishEventLoop(&server->loop);
 }
 
 void scheduleRedraw(struct DeskServer *server) {
@@ -165,90 +249,82 @@ void scheduleRedraw(struct DeskServer *server) {
   }
 }
 
-void damageWholeServer(struct DeskServer *server) {
-  struct Output *output;
-  wl_list_for_each(output, &server->outputs, link) {
-    damageOutputWhole(output);
+/* Pointer events move the cursor, so they are first seen on the
+ * cursor's output */
+void noteInput(struct DeskServer *server, int64_t ns, uint32_t time_msec) {
+  noteInputQueueing(&server->loop, time_msec);
+
+  struct wlr_output *wlr_output = wlr_output_layout_output_at(
+    server->outputLayout, server->cursor->x, server->cursor->y);
+  if (wlr_output && wlr_output->data) {
+    noteOutputInput(wlr_output->data, ns);
   }
 }
 
-static void getViewDamageBox(struct View *view, struct wlr_box *box) {
-  if (!view->xdg || !view->xdg->surface) {
-    *box = (struct wlr_box){0, 0, 0, 0};
-    return;
+/* Keys only show once the focused client has drawn its response, so the
+ * stamp waits on the view until a commit of it brings damage. With no
+ * view focused nothing shows them. */
+void noteKeyInput(struct DeskServer *server, int64_t ns) {
+  if (server->focused_view) {
+    server->focused_view->pendingKeyNs = ns;
   }
+}
 
-  struct wlr_box surface_box;
-  wlr_surface_get_extents(view->xdg->surface, &surface_box);
-
-  /* Rotation pivot matches rendering: center of main surface extents */
-  float pivot_x = view->x + surface_box.width / 2.0f;
-  float pivot_y = view->y + surface_box.height / 2.0f;
-
-  float cos_r = cosf(view->rot);
-  float sin_r = sinf(view->rot);
-
-  /* Compute axis-aligned bounding box by rotating all 4 corners of extents around pivot */
-  float ext_x = view->x + surface_box.x;
-  float ext_y = view->y + surface_box.y;
-  float ext_w = surface_box.width;
-  float ext_h = surface_box.height;
-
-  /* Four corners of the extent box in absolute coordinates */
-  float corners[4][2] = {
-    {ext_x, ext_y},
-    {ext_x + ext_w, ext_y},
-    {ext_x + ext_w, ext_y + ext_h},
-    {ext_x, ext_y + ext_h}
-  };
-
-  float min_x = pivot_x, max_x = pivot_x, min_y = pivot_y, max_y = pivot_y;
-  for (int i = 0; i < 4; i++) {
-    /* Rotate corner around pivot */
-    float dx = corners[i][0] - pivot_x;
-    float dy = corners[i][1] - pivot_y;
-    float rx = dx * cos_r - dy * sin_r + pivot_x;
-    float ry = dx * sin_r + dy * cos_r + pivot_y;
-    if (rx < min_x) min_x = rx;
-    if (rx > max_x) max_x = rx;
-    if (ry < min_y) min_y = ry;
-    if (ry > max_y) max_y = ry;
-  }
-
-  box->x = (int)floorf(min_x) - 1;
-  box->y = (int)floorf(min_y) - 1;
-  box->width = (int)ceilf(max_x - min_x) + 2;
-  box->height = (int)ceilf(max_y - min_y) + 2;
-}
-
-static void damageView(struct DeskServer *server, struct View *view) {
-  struct wlr_box box;
-  getViewDamageBox(view, &box);
-  
+void dumpLatency(struct DeskServer *server) {
   struct Output *output;
   wl_list_for_each(output, &server->outputs, link) {
-    damageOutputBox(output, &box);
+    logOutputLatency(output);
+  }
+  logEventLoop(&server->loop);
+  if (server->jitter) {
+    logJitter(server->jitter);
   }
 }
 
-static void damageAllOutputs(struct DeskServer *server) {
+void damageWholeServer(struct DeskServer *server) {
   struct Output *output;
   wl_list_for_each(output, &server->outputs, link) {
     damageOutputWhole(output);
   }
 }
 
-static void damageCursor(struct DeskServer *server, double x, double y) {
-  int radius = 20;
-  struct wlr_box box = {
-    .x = (int)x - radius,
-    .y = (int)y - radius,
-    .width = radius * 2,
-    .height = radius * 2,
-  };
+/* The view's pose just changed under a clean node: damage the union of the
+ * old and new regions in one go */
+static void damageViewMove(struct DeskServer *server, struct View *view) {
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  pixman_region32_copy(&damage, &view->node.region);
+
+  view->node.dirty = true;
+  pixman_region32_union(&damage, &damage, &viewNode(view)->region);
+
   struct Output *output;
   wl_list_for_each(output, &server->outputs, link) {
-    damageOutputBox(output, &box);
+    damageOutputRegion(output, &damage);
+  }
+  pixman_region32_fini(&damage);
+}
+
+
+/* Only the lens cursor is part of the rendered scene; the regular cursor
+ * lives on the cursor plane and moving it damages nothing. Damages where
+ * the cursor node was and where it is after the move. */
+static void damageCursor(struct DeskServer *server) {
+  struct SceneNode *before = cursorNode(server);
+  struct wlr_box old_box = before->bounds;
+  bool was_visible = before->visible;
+
+  server->cursorNode.dirty = true;
+  struct SceneNode *node = cursorNode(server);
+
+  struct Output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    if (was_visible) {
+      damageOutputCursor(output, &old_box);
+    }
+    if (node->visible) {
+      damageOutputCursor(output, &node->bounds);
+    }
   }
 }
 
@@ -256,60 +332,239 @@ static void damageLayerSurfaceBox(struct LayerSurface *ls) {
   if (!ls || !ls->output || !ls->layer_surface->surface) {
     return;
   }
-  struct wlr_box box;
-  wlr_surface_get_extents(ls->layer_surface->surface, &box);
-  box.x += ls->x;
-  box.y += ls->y;
+  struct wlr_box box = layerNode(ls)->bounds;
   damageOutputBox(ls->output, &box);
 }
 
+static void trackerDestroy(struct wlr_addon *addon);
+
+static const struct wlr_addon_interface trackerImpl = {
+  .name = "desk_surface_tracker",
+  .destroy = trackerDestroy,
+};
+
+static struct SurfaceTracker *surfaceTracker(struct DeskServer *server, struct wlr_surface *surface) {
+  struct wlr_addon *addon = wlr_addon_find(&surface->addons, server, &trackerImpl);
+  if (!addon) {
+    return NULL;
+  }
+  struct SurfaceTracker *tracker = wl_container_of(addon, tracker, addon);
+  return tracker;
+}
+
+void setSurfaceOwner(struct DeskServer *server, struct wlr_surface *surface,
+                     enum SurfaceOwnerType type, void *owner) {
+  struct SurfaceTracker *tracker = surfaceTracker(server, surface);
+  if (tracker) {
+    tracker->ownerType = owner ? type : SURFACE_OWNER_NONE;
+    tracker->owner = owner;
+  }
+}
+
+/* Damage a popup where it is now and where it was last damaged. Walks up
+ * the popup chain to the view or layer surface the popup is placed in. */
+static void damagePopup(struct DeskServer *server, struct SurfaceTracker *tracker,
+                        struct wlr_xdg_popup *popup) {
+  struct wlr_box local;
+  wlr_surface_get_extents(popup->base->surface, &local);
+
+  struct SceneNode *node = NULL;
+  struct Output *output = NULL;
+  while (popup && popup->parent) {
+    double px, py;
+    wlr_xdg_popup_get_position(popup, &px, &py);
+    local.x += (int)px;
+    local.y += (int)py;
+
+    struct SurfaceTracker *parent = surfaceTracker(server, wlr_surface_get_root_surface(popup->parent));
+    if (parent && parent->ownerType == SURFACE_OWNER_VIEW) {
+      struct View *view = parent->owner;
+      view->cacheDirty = true;
+      node = viewNode(view);
+      break;
+    }
+    if (parent && parent->ownerType == SURFACE_OWNER_LAYER) {
+      struct LayerSurface *ls = parent->owner;
+      node = layerNode(ls);
+      output = ls->output;
+      break;
+    }
+
+    struct wlr_xdg_surface *xdg = wlr_xdg_surface_try_from_wlr_surface(popup->parent);
+    popup = xdg && xdg->role == WLR_XDG_SURFACE_ROLE_POPUP ? xdg->popup : NULL;
+  }
+
+  struct wlr_box box = {0};
+  if (node && node->visible) {
+    sceneNodeToLayout(node, &local, 1, &box);
+  }
+
+  struct Output *o;
+  wl_list_for_each(o, &server->outputs, link) {
+    if (output && o != output) {
+      continue;
+    }
+    if (!wlr_box_empty(&tracker->lastDamage)) {
+      damageOutputBox(o, &tracker->lastDamage);
+    }
+    if (!wlr_box_empty(&box)) {
+      damageOutputBox(o, &box);
+    }
+  }
+  tracker->lastDamage = box;
+}
+
+struct TreePlacement {
+  struct DeskServer *server;
+  int surfaces;
+  bool changed;
+};
+
+/* Note every surface whose place or size in the tree moved since last seen */
+static void treePlacementIter(struct wlr_surface *surface, int x, int y, void *data) {
+  struct TreePlacement *ctx = data;
+  ctx->surfaces++;
+
+  struct SurfaceTracker *tracker = surfaceTracker(ctx->server, surface);
+  if (!tracker) {
+    ctx->changed = true;
+    return;
+  }
+  struct wlr_box box = { x, y, surface->current.width, surface->current.height };
+  if (!wlr_box_equal(&box, &tracker->treeBox)) {
+    tracker->treeBox = box;
+    ctx->changed = true;
+  }
+}
+
+/* Damage just the pixels the commit changed: the surface's buffer damage,
+ * offset to its place in the tree and mapped through the view's node */
+static void damageSurfaceCommit(struct DeskServer *server, struct View *view,
+                                struct SurfaceTracker *tracker, struct wlr_surface *surface) {
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+  wlr_surface_get_effective_damage(surface, &damage);
+
+  /* Nothing to redraw, but a frame callback to answer */
+  if (!pixman_region32_not_empty(&damage) &&
+      !wl_list_empty(&surface->current.frame_callback_list)) {
+    scheduleViewFrame(view);
+  }
+
+  /* The client's response to the last keys is in; the next frame of the
+   * view's output is where they are first seen */
+  if (view->pendingKeyNs && pixman_region32_not_empty(&damage)) {
+    /* Too long after the key to be its response rather than something
+     * unrelated, like a cursor blink */
+    struct Output *output = viewPrimaryOutput(view);
+    if (output && monotonicNs() - view->pendingKeyNs <= (int64_t)KEY_RESPONSE_WINDOW_MS * 1000000) {
+      noteOutputInput(output, view->pendingKeyNs);
+    }
+    view->pendingKeyNs = 0;
+  }
+
+  /* A pile of small rects costs more to track than their bounding box */
+  if (pixman_region32_n_rects(&damage) > MAX_SPLIT_RECTS) {
+    pixman_box32_t extents = *pixman_region32_extents(&damage);
+    pixman_region32_reset(&damage, &extents);
+  }
+
+  struct SceneNode *node = viewNode(view);
+  int num_rects = 0;
+  pixman_box32_t *rects = pixman_region32_rectangles(&damage, &num_rects);
+  for (int i = 0; i < num_rects; i++) {
+    struct wlr_box local = {
+      .x = tracker->treeBox.x + rects[i].x1,
+      .y = tracker->treeBox.y + rects[i].y1,
+      .width = rects[i].x2 - rects[i].x1,
+      .height = rects[i].y2 - rects[i].y1,
+    };
+    struct wlr_box box;
+    sceneNodeToLayout(node, &local, 1, &box);
+
+    struct Output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+      damageOutputBox(output, &box);
+    }
+  }
+  pixman_region32_fini(&damage);
+}
+
 static void surfaceCommitHandler(struct wl_listener *listener, void *data) {
   struct SurfaceTracker *tracker = wl_container_of(listener, tracker, commit);
   struct wlr_surface *surface = data;
   
+  /* Subsurfaces are damaged as part of their root */
   struct wlr_surface *root = wlr_surface_get_root_surface(surface);
-  
-  struct View *view;
-  wl_list_for_each(view, &tracker->server->views, link) {
-    if (view->xdg && view->xdg->surface == root) {
-      damageView(tracker->server, view);
+  struct SurfaceTracker *owner = root == surface ? tracker : surfaceTracker(tracker->server, root);
+  if (!owner) {
+    return;
+  }
+
+  switch (owner->ownerType) {
+  case SURFACE_OWNER_VIEW: {
+    struct View *view = owner->owner;
+    view->cacheDirty = true;
+    if (!viewNode(view)->visible) {
+      view->node.dirty = true;
       return;
     }
-  }
-  
-  /* Check layer surfaces */
-  struct Output *output;
-  wl_list_for_each(output, &tracker->server->outputs, link) {
-    for (int layer = 0; layer < 4; layer++) {
-      struct LayerSurface *ls;
-      wl_list_for_each(ls, &output->layers[layer], link) {
-        if (ls->layer_surface->surface == root) {
-          damageLayerSurfaceBox(ls);
-          return;
-        }
-      }
+
+    struct TreePlacement placement = { .server = tracker->server };
+    wlr_surface_for_each_surface(root, treePlacementIter, &placement);
+    bool resized = placement.changed || placement.surfaces != view->treeSurfaces;
+    view->treeSurfaces = placement.surfaces;
+
+    if (resized) {
+      /* The tree was rearranged: damage both placements whole */
+      damageViewMove(tracker->server, view);
+    } else {
+      damageSurfaceCommit(tracker->server, view, tracker, surface);
     }
+    return;
   }
-  
-  damageAllOutputs(tracker->server);
+  case SURFACE_OWNER_LAYER: {
+    struct LayerSurface *ls = owner->owner;
+    damageLayerSurfaceBox(ls);
+    ls->node.dirty = true;
+    damageLayerSurfaceBox(ls);
+    return;
+  }
+  case SURFACE_OWNER_NONE:
+    break;
+  }
+
+  /* Popups are drawn as part of their toplevel's or layer surface's tree */
+  struct wlr_xdg_surface *xdg = wlr_xdg_surface_try_from_wlr_surface(root);
+  if (xdg && xdg->role == WLR_XDG_SURFACE_ROLE_POPUP) {
+    damagePopup(tracker->server, owner, xdg->popup);
+  }
+  /* Anything else (cursor images, role-less surfaces) isn't in the scene */
 }
 
-static void surfaceDestroyHandler(struct wl_listener *listener, void *data) {
-  struct SurfaceTracker *tracker = wl_container_of(listener, tracker, destroy);
+/* Runs when the surface's addon set is torn down on destruction */
+static void trackerDestroy(struct wlr_addon *addon) {
+  struct SurfaceTracker *tracker = wl_container_of(addon, tracker, addon);
+  if (!wlr_box_empty(&tracker->lastDamage)) {
+    struct Output *output;
+    wl_list_for_each(output, &tracker->server->outputs, link) {
+      damageOutputBox(output, &tracker->lastDamage);
+    }
+  }
+  wlr_addon_finish(&tracker->addon);
   wl_list_remove(&tracker->commit.link);
-  wl_list_remove(&tracker->destroy.link);
   free(tracker);
 }
 
 HANDLE(newSurface, struct wlr_surface, DeskServer) {
   struct SurfaceTracker *tracker = calloc(1, sizeof(struct SurfaceTracker));
+  ASSERTN(tracker);
   tracker->server = container;
+  tracker->ownerType = SURFACE_OWNER_NONE;
+  wlr_addon_init(&tracker->addon, &data->addons, container, &trackerImpl);
   
   tracker->commit.notify = surfaceCommitHandler;
   wl_signal_add(&data->events.commit, &tracker->commit);
-  
-  tracker->destroy.notify = surfaceDestroyHandler;
-  wl_signal_add(&data->events.destroy, &tracker->destroy);
 }
 
 HANDLE(newXdgSurface, struct wlr_xdg_surface, DeskServer){
@@ -390,7 +645,29 @@ HANDLE(newInput, struct wlr_input_device, DeskServer){
   }
   wlr_seat_set_capabilities(container->seat, caps);
 }
+void setLensCursor(struct DeskServer *server, bool lens) {
+  server->lensCursor = lens;
+  server->cursorNode.dirty = true;
+  if (lens) {
+    /* The lens is drawn into the scene, keep the cursor plane empty */
+    wlr_cursor_unset_image(server->cursor);
+  } else {
+    wlr_cursor_set_xcursor(server->cursor, server->cursorMgr, "default");
+    processCursorMotion(server, 0);
+  }
+  damageWholeServer(server);
+}
+
 HANDLE(requestCursor, struct wlr_seat_pointer_request_set_cursor_event, DeskServer){
+  if (container->lensCursor) {
+    return;
+  }
+  /* Only the client holding pointer focus may set the cursor image */
+  if (data->seat_client != container->seat->pointer_state.focused_client) {
+    return;
+  }
+  wlr_cursor_set_surface(container->cursor, data->surface,
+                         data->hotspot_x, data->hotspot_y);
 }
 HANDLE(requestSetSelection, struct wlr_seat_request_set_selection_event, DeskServer){
   LOG("asrta");
@@ -414,6 +691,9 @@ static void processCursorMotion(struct DeskServer *server, uint32_t time) {
   
   if (!view) {
     /* No view under cursor, clear pointer focus */
+    if (!server->lensCursor) {
+      wlr_cursor_set_xcursor(server->cursor, server->cursorMgr, "default");
+    }
     wlr_seat_pointer_clear_focus(server->seat);
   } else {
     /* Send pointer enter/motion to the surface */
@@ -423,10 +703,10 @@ static void processCursorMotion(struct DeskServer *server, uint32_t time) {
 }
 
 HANDLE(cursorMotion, struct wlr_pointer_motion_event, DeskServer){
-  damageCursor(container, container->cursor->x, container->cursor->y);
+  int64_t arrived = monotonicNs();
   wlr_cursor_move(container->cursor, &data->pointer->base,
 		  data->delta_x, data->delta_y);
-  damageCursor(container, container->cursor->x, container->cursor->y);
+  damageCursor(container);
   
   /* Update window position if in move mode */
   if (container->moveMode && container->grabbed_view) {
@@ -435,15 +715,17 @@ HANDLE(cursorMotion, struct wlr_pointer_motion_event, DeskServer){
     /* Set target position for smooth movement */
     container->grabbed_view->target_x = container->grab_view_x + (int)dx;
     container->grabbed_view->target_y = container->grab_view_y + (int)dy;
+    wakeAnimation(container);
   } else {
     processCursorMotion(container, data->time_msec);
   }
   wlr_seat_pointer_notify_frame(container->seat);
+  noteInput(container, arrived, data->time_msec);
 }
 HANDLE(cursorMotionAbsolute, struct wlr_pointer_motion_absolute_event, DeskServer){
-  damageCursor(container, container->cursor->x, container->cursor->y);
+  int64_t arrived = monotonicNs();
   wlr_cursor_warp_absolute(container->cursor, &data->pointer->base, data->x, data->y);
-  damageCursor(container, container->cursor->x, container->cursor->y);
+  damageCursor(container);
   
   /* Update window position if in move mode */
   if (container->moveMode && container->grabbed_view) {
@@ -452,12 +734,15 @@ HANDLE(cursorMotionAbsolute, struct wlr_pointer_motion_absolute_event, DeskServe
     /* Set target position for smooth movement */
     container->grabbed_view->target_x = container->grab_view_x + (int)dx;
     container->grabbed_view->target_y = container->grab_view_y + (int)dy;
+    wakeAnimation(container);
   } else {
     processCursorMotion(container, data->time_msec);
   }
   wlr_seat_pointer_notify_frame(container->seat);
+  noteInput(container, arrived, data->time_msec);
 }
 HANDLE(cursorButton, struct wlr_pointer_button_event, DeskServer){
+  noteInput(container, monotonicNs(), data->time_msec);
   /* Update motion before button to ensure coordinates are current */
   processCursorMotion(container, data->time_msec);
   
@@ -583,6 +868,7 @@ HANDLE(resizeHandler, int, DeskServer) {
     if (view) {
       /* Set target rotation for smooth rotation */
       view->target_rot += *data * (PI / 1000);
+      wakeAnimation(container);
       
       /* Re-send motion event with updated surface-local coords after rotation */
       processCursorMotion(container, 0);
@@ -3,15 +3,32 @@
 #include "keyboard.h"
 #include "events.h"
 #include "shader.h"
+#include "scene.h"
+#include "realtime.h"
+#include "loop.h"
+
+enum SurfaceOwnerType {
+  SURFACE_OWNER_NONE,           // subsurfaces, popups and role-less surfaces
+  SURFACE_OWNER_VIEW,
+  SURFACE_OWNER_LAYER,
+};
 
+/* Attached to every wlr_surface as an addon, so a commit finds what the
+ * surface belongs to without searching */
 struct SurfaceTracker {
+  struct wlr_addon addon;
   struct wl_listener commit;
-  struct wl_listener destroy;
   struct DeskServer *server;
+
+  enum SurfaceOwnerType ownerType;
+  void *owner;
+  struct wlr_box lastDamage;    // layout box last damaged for a popup
+  struct wlr_box treeBox;       // placement within its root's tree when last seen
 };
 
 typedef struct DeskServer {
   struct wl_display *display;
+  struct eventLoop loop;
   struct wlr_backend *backend;
   struct wlr_renderer *renderer;
   struct wlr_allocator *allocator;
@@ -29,6 +46,17 @@ typedef struct DeskServer {
   struct wlr_layer_shell_v1 *layerShell;
   struct wl_listener newLayerSurface;
 
+  // Presentation hints: async page flips and content type
+  struct wlr_tearing_control_manager_v1 *tearingControl;
+  struct wlr_content_type_manager_v1 *contentType;
+
+  // wp_presentation: tells clients when and how their content was shown
+  struct wlr_presentation *presentation;
+
+  // Serves hidden views' frame callbacks when no output frame does
+  struct wl_event_source *frameThrottleTimer;
+  bool frameThrottleArmed;
+
   // Input
   struct wlr_seat *seat;
   struct wl_listener newInput;
@@ -37,6 +65,9 @@ typedef struct DeskServer {
 
   // Mouse
   struct wlr_cursor *cursor;
+  struct wlr_xcursor_manager *cursorMgr;
+  bool lensCursor;  // draw the lens in the scene instead of using the cursor plane
+  struct SceneNode cursorNode;
   struct wl_listener cursorMotion;
   struct wl_listener cursorMotionAbsolute;
   struct wl_listener cursorButton;
@@ -77,18 +108,33 @@ typedef struct DeskServer {
   double grab_x, grab_y;  // cursor position at grab start
   int grab_view_x, grab_view_y;  // view position at grab start
   
-  // Animation loop
-  struct wl_event_source *animation_timer;
+  // Spring animation clock, advanced from output frames while a view moves
+  bool animating;
+  struct timespec animationTime;
+  double animationLag;  // seconds not yet integrated, under one step
   
   // Debug mode
   bool debugDamage;
+  struct wl_event_source *latencySignal;
+
+  // Scheduling of the event loop thread, and how late its timers fire
+  struct realtimeOptions realtime;
+  struct jitterProbe *jitter;
 } DeskServer;
 
 struct DeskServer *newServer();
 void startServer(struct DeskServer*);
+void stopServer(struct DeskServer*);
 void destroyServer(struct DeskServer*);
 void scheduleRedraw(struct DeskServer*);
+void wakeAnimation(struct DeskServer*);
+void animateViews(struct DeskServer*, const struct timespec *when);
 void damageWholeServer(struct DeskServer*);
+void noteInput(struct DeskServer*, int64_t ns, uint32_t time_msec);
+void noteKeyInput(struct DeskServer*, int64_t ns);
+void dumpLatency(struct DeskServer*);
+void setLensCursor(struct DeskServer*, bool);
+void setSurfaceOwner(struct DeskServer*, struct wlr_surface*, enum SurfaceOwnerType, void *owner);
 
 LISTNER(newXdgSurface, struct wlr_xdg_surface, DeskServer);
 LISTNER(newXdgToplevel, struct wlr_xdg_toplevel, DeskServer);
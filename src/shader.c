@@ -1,5 +1,32 @@
 #include "shader.h"
 
+static const char *uniformNames[UNIFORM_COUNT] = {
+  [U_MODEL] = "model",
+  [U_TEX_RECT] = "texRect",
+  [U_TEXTURE] = "s_texture",
+  [U_CENTER] = "u_center",
+  [U_RADIUS] = "u_radius",
+  [U_SCREEN_TEXTURE] = "u_screen_texture",
+  [U_COLOR] = "u_color",
+};
+
+/* Cache uniform locations and hook the program up to the frame uniform block */
+static void resolveUniforms(struct shader *shader) {
+  for (int i = 0; i < UNIFORM_COUNT; i++) {
+    shader->locations[i] = glGetUniformLocation(shader->ID, uniformNames[i]);
+  }
+
+  GLuint frameBlock = glGetUniformBlockIndex(shader->ID, "Frame");
+  if (frameBlock != GL_INVALID_INDEX) {
+    glUniformBlockBinding(shader->ID, frameBlock, FRAME_UBO_BINDING);
+  }
+
+  /* Samplers always read from texture unit 0 */
+  glUseProgram(shader->ID);
+  glUniform1i(shader->locations[U_TEXTURE], 0);
+  glUniform1i(shader->locations[U_SCREEN_TEXTURE], 0);
+}
+
 struct shader* newShader(const char* vertFilePath, const char* fragFilePath) {
   FILE *vertFile, *fragFile;
   long length;
@@ -59,7 +86,7 @@ struct shader* newShader(const char* vertFilePath, const char* fragFilePath) {
   }
 
   // Program
-  struct shader *shader = malloc(sizeof(shader));
+  struct shader *shader = malloc(sizeof(struct shader));
   shader->ID = glCreateProgram();
   glAttachShader(shader->ID, vertex);
   glAttachShader(shader->ID, fragment);
@@ -81,6 +108,7 @@ struct shader* newShader(const char* vertFilePath, const char* fragFilePath) {
 
   shader->fragFile = fragFilePath;
   shader->vertFile = vertFilePath;
+  resolveUniforms(shader);
 
   LOG("Loaded shader from \"%s\" and \"%s\"", vertFilePath, fragFilePath);
 
@@ -92,6 +120,7 @@ void reloadShader(struct shader *shader) {
   if(!replacement) return;
   glDeleteProgram(shader->ID);
   shader->ID = replacement->ID;
+  memcpy(shader->locations, replacement->locations, sizeof(shader->locations));
   free(replacement);
 }
 
@@ -104,14 +133,22 @@ void useShader(struct shader *shader) {
   glUseProgram(shader->ID);
 }
 
-void setInt(struct shader *shader, const char* loc, int val) {
-  glUniform1i(glGetUniformLocation(shader->ID, loc), val);
+void setInt(struct shader *shader, enum uniform loc, int val) {
+  glUniform1i(shader->locations[loc], val);
+}
+
+void setFloat(struct shader *shader, enum uniform loc, float val) {
+  glUniform1f(shader->locations[loc], val);
+}
+
+void set2f(struct shader *shader, enum uniform loc, float x, float y) {
+  glUniform2f(shader->locations[loc], x, y);
 }
 
-void setFloat(struct shader *shader, const char* loc, float val) {
-  glUniform1f(glGetUniformLocation(shader->ID, loc), val);
+void set4f(struct shader *shader, enum uniform loc, float x, float y, float z, float w) {
+  glUniform4f(shader->locations[loc], x, y, z, w);
 }
 
-void set4fv(struct shader *shader, const char* loc, GLsizei count, GLboolean transpose, float *val) {
-  glUniformMatrix4fv(glGetUniformLocation(shader->ID, loc), count, transpose, val);
+void set4fv(struct shader *shader, enum uniform loc, GLsizei count, GLboolean transpose, float *val) {
+  glUniformMatrix4fv(shader->locations[loc], count, transpose, val);
 }
@@ -2,8 +2,33 @@
 #include <stdlib.h>
 #include "imports.h"
 
+/* Uniforms whose locations are resolved once at link time */
+enum uniform {
+  U_MODEL,
+  U_TEX_RECT,
+  U_TEXTURE,
+  U_CENTER,
+  U_RADIUS,
+  U_SCREEN_TEXTURE,
+  U_COLOR,
+  UNIFORM_COUNT
+};
+
+/* Binding point of the `Frame` uniform block shared by every shader */
+#define FRAME_UBO_BINDING 0
+
+/* std140 layout of the `Frame` uniform block, uploaded once per output per frame */
+struct frameUniforms {
+  mat4 projection;
+  mat4 view;
+  vec2 outputSize;
+  float time;
+  float _pad;
+};
+
 struct shader {
   unsigned int ID;
+  GLint locations[UNIFORM_COUNT];
   const char *vertFile;
   const char *fragFile;  
 };
@@ -12,6 +37,8 @@ struct shader* newShader(const char*, const char*);
 void reloadShader(struct shader *);
 void destroyShader(struct shader *);
 void useShader(struct shader *);
-void setInt(struct shader *, const char*, int);
-void setFloat(struct shader *, const char*, float);
-void set4fv(struct shader *, const char* , GLsizei, GLboolean, float *);
+void setInt(struct shader *, enum uniform, int);
+void setFloat(struct shader *, enum uniform, float);
+void set2f(struct shader *, enum uniform, float, float);
+void set4f(struct shader *, enum uniform, float, float, float, float);
+void set4fv(struct shader *, enum uniform, GLsizei, GLboolean, float *);
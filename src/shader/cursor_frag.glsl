@@ -4,8 +4,14 @@ precision mediump float;
 in vec2 v_uv;
 in vec2 v_screen_pos;
 
-uniform vec2 u_resolution;
+layout(std140) uniform Frame {
+  highp mat4 projection;
+  highp mat4 view;
+  highp vec2 outputSize;
+  highp float time;
+};
 uniform vec2 u_center;
+uniform float u_radius;
 uniform sampler2D u_screen_texture;
 
 out vec4 out_color;
@@ -30,13 +36,13 @@ void main() {
         sampleLocalPos = normalize(sampleLocalPos) * 0.99;
     }
 
-    // Convert to screen UV
-    float radius = 28.0;
-    vec2 sampleScreenPos = v_screen_pos + sampleLocalPos * radius;
-    vec2 screenUV = sampleScreenPos / u_resolution;
+    // Convert to screen UV; the lens gathers from twice its own radius
+    vec2 sampleScreenPos = v_screen_pos + sampleLocalPos * u_radius * 2.0;
+    vec2 screenUV = sampleScreenPos / outputSize;
 
-    // Chromatic aberration - sample RGB at slightly different offsets
-    float chromaticOffset = 0.008 * (1.0 - sphereProfile);
+    // Chromatic aberration - sample RGB at slightly different offsets,
+    // at most one lens radius further out
+    vec2 chromaticOffset = u_radius * (1.0 - sphereProfile) / outputSize;
     vec2 offsetDir = normalize(uv + vec2(0.001));
     
     float r = texture(u_screen_texture, screenUV + offsetDir * chromaticOffset).r;
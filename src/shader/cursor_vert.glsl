@@ -3,7 +3,12 @@ precision mediump float;
 
 layout(location = 0) in vec2 a_position;
 
-uniform vec2 u_resolution;
+layout(std140) uniform Frame {
+  highp mat4 projection;
+  highp mat4 view;
+  highp vec2 outputSize;
+  highp float time;
+};
 uniform vec2 u_center;
 uniform float u_radius;
 
@@ -17,6 +22,6 @@ void main() {
     v_screen_pos = world;
     
     // Convert to NDC: flip Y for position only, keep v_screen_pos in Wayland coords for texture sampling
-    vec2 ndc = (world / u_resolution) * 2.0 - 1.0;
+    vec2 ndc = (world / outputSize) * 2.0 - 1.0;
     gl_Position = vec4(ndc.x, ndc.y, 0.0, 1.0);
 }
@@ -4,7 +4,12 @@ in vec2 v_texCoord;
 layout(location = 0) out vec4 outColor;           
 uniform sampler2D s_texture;
 
-uniform float time;
+layout(std140) uniform Frame {
+  highp mat4 projection;
+  highp mat4 view;
+  highp vec2 outputSize;
+  highp float time;
+};
 
 void main()
 {
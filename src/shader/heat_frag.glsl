@@ -0,0 +1,25 @@
+#version 300 es
+precision mediump float;
+
+// Overdraw counts, one 1/255 step in red per fragment drawn
+uniform sampler2D u_screen_texture;
+
+out vec4 fragColor;
+
+void main() {
+    float layers = texelFetch(u_screen_texture, ivec2(gl_FragCoord.xy), 0).r * 255.0;
+    if (layers < 0.5) {
+        discard;
+    }
+
+    // 1 layer blue, 2 green, 3 yellow, 4 orange, 5 or more red
+    vec3 ramp[5] = vec3[5](
+        vec3(0.0, 0.3, 1.0),
+        vec3(0.0, 0.9, 0.2),
+        vec3(1.0, 0.9, 0.0),
+        vec3(1.0, 0.5, 0.0),
+        vec3(1.0, 0.0, 0.0)
+    );
+    int index = clamp(int(layers + 0.5) - 1, 0, 4);
+    fragColor = vec4(ramp[index], 0.45);
+}
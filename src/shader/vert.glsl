@@ -2,11 +2,16 @@
 layout(location = 0) in vec3 a_position;  
 layout(location = 1) in vec2 a_texCoord;  
 out vec2 v_texCoord;                      
+layout(std140) uniform Frame {
+  highp mat4 projection;
+  highp mat4 view;
+  highp vec2 outputSize;
+  highp float time;
+};
 uniform mat4 model;                       
-uniform mat4 view;                        
-uniform mat4 projection;                  
+uniform vec4 texRect; // uv offset (xy) and scale (zw)
 void main()                               
 {                                         
    gl_Position = projection * view * model * vec4(a_position, 1);
-   v_texCoord = a_texCoord;               
+   v_texCoord = texRect.xy + a_texCoord * texRect.zw;
 }                                          
@@ -16,6 +16,8 @@ struct View *mkView(struct DeskServer *container, struct wlr_xdg_surface *data){
 
   if (data->toplevel) {
     ATTACH(View, view, data->toplevel->events.request_move, requestMove);
+    ATTACH(View, view, data->toplevel->events.request_maximize, requestMaximize);
+    ATTACH(View, view, data->toplevel->events.request_fullscreen, requestFullscreen);
   }
 
   view->fadeIn = 1;
@@ -30,6 +32,10 @@ struct View *mkView(struct DeskServer *container, struct wlr_xdg_surface *data){
   view->rot_vel = 0.0f;
   view->target_rot = 0.0f;
   view->dampening = 0.35f;  // Friction: higher = smoother/laggier
+  view->cacheDirty = true;
+  pixman_region32_init(&view->cacheOpaque);
+  initSceneNode(&view->node, SCENE_NODE_VIEW);
+  setSurfaceOwner(container, data->surface, SURFACE_OWNER_VIEW, view);
 
   return view;
 }
@@ -47,6 +53,13 @@ void destroyView(struct View *view){
   wl_list_remove(&view->destroy.link);
   wl_list_remove(&view->commit.link);
   wl_list_remove(&view->requestMove.link);
+  wl_list_remove(&view->requestMaximize.link);
+  wl_list_remove(&view->requestFullscreen.link);
+
+  setSurfaceOwner(view->server, view->xdg->surface, SURFACE_OWNER_NONE, NULL);
+  releaseViewCache(view);
+  pixman_region32_fini(&view->cacheOpaque);
+  finishSceneNode(&view->node);
   
   free(view);
 }
@@ -87,10 +100,69 @@ void focusView(struct View *view, struct wlr_surface *surface) {
       keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
   }
   
+  /* Keys sent to the old view will not be answered by this one */
+  if (server->focused_view && server->focused_view != view) {
+    server->focused_view->pendingKeyNs = 0;
+  }
   server->focused_view = view;
   damageWholeServer(server);
 }
 
+/* Output under the view's center, or the first one */
+static struct wlr_output *viewOutput(struct View *view) {
+  struct DeskServer *server = view->server;
+  struct point center = centerPoint(*view);
+  struct wlr_output *output =
+    wlr_output_layout_output_at(server->outputLayout, center.x, center.y);
+  if (!output && !wl_list_empty(&server->outputs)) {
+    struct Output *first = wl_container_of(server->outputs.next, first, link);
+    output = first->wlr_output;
+  }
+  return output;
+}
+
+/* Maximized and fullscreen views both cover their whole output, unrotated
+ * and unscaled, so that the output can scan them out directly */
+void setViewState(struct View *view, bool maximized, bool fullscreen) {
+  struct wlr_xdg_toplevel *toplevel = view->xdg->toplevel;
+  bool wasCovering = view->maximized || view->fullscreen;
+  bool covering = maximized || fullscreen;
+  struct wlr_output *output = viewOutput(view);
+
+  if (covering && output) {
+    if (!wasCovering) {
+      view->saved_x = view->target_x;
+      view->saved_y = view->target_y;
+      view->saved_rot = view->target_rot;
+    }
+
+    struct wlr_box box;
+    wlr_output_layout_get_box(view->server->outputLayout, output, &box);
+    struct wlr_box *geometry = &view->xdg->geometry;
+    view->target_x = box.x - geometry->x;
+    view->target_y = box.y - geometry->y;
+    view->target_rot = 0;
+    view->scale = 1;
+    wlr_xdg_toplevel_set_size(toplevel, box.width, box.height);
+  } else {
+    covering = maximized = fullscreen = false;
+    if (wasCovering) {
+      view->target_x = view->saved_x;
+      view->target_y = view->saved_y;
+      view->target_rot = view->saved_rot;
+      wlr_xdg_toplevel_set_size(toplevel, 0, 0);
+    }
+  }
+
+  view->maximized = maximized;
+  view->fullscreen = fullscreen;
+  view->node.dirty = true;
+  wakeAnimation(view->server);
+  wlr_xdg_toplevel_set_maximized(toplevel, maximized);
+  wlr_xdg_toplevel_set_fullscreen(toplevel, fullscreen);
+  damageWholeServer(view->server);
+}
+
 struct View *viewAt(struct DeskServer *server, double lx, double ly,
                     struct wlr_surface **surface, double *sx, double *sy) {
   struct View *view;
@@ -99,31 +171,9 @@ struct View *viewAt(struct DeskServer *server, double lx, double ly,
       continue;
     }
     
-    /* Get surface dimensions for center calculation */
-    struct wlr_box box = {0};
-    wlr_surface_get_extents(view->xdg->surface, &box);
-    
-    /* Calculate view center in layout coordinates */
-    double cx = view->x + box.width / 2.0;
-    double cy = view->y + box.height / 2.0;
-    
-    /* Transform cursor position by INVERSE rotation around view center.
-     * 
-     * Rendering applies rotation R(θ) to surface points.
-     * To find surface coords from screen coords, apply R(-θ).
-     * 
-     * R(-θ) = [cos(θ)   sin(θ)]
-     *         [-sin(θ)  cos(θ)]
-     */
-    double dx = lx - cx;
-    double dy = ly - cy;
-    
-    double cos_r = cos(view->rot);
-    double sin_r = sin(view->rot);
-    
-    /* Inverse rotation: R(-θ) * (dx, dy) */
-    double view_sx = (dx * cos_r + dy * sin_r) + box.width / 2.0;
-    double view_sy = (-dx * sin_r + dy * cos_r) + box.height / 2.0;
+    /* Undo the view's rotation about its center with the node's inverse */
+    double view_sx, view_sy;
+    sceneNodeToLocal(viewNode(view), lx, ly, &view_sx, &view_sy);
     
     double _sx, _sy;
     struct wlr_surface *_surface = 
@@ -139,6 +189,14 @@ struct View *viewAt(struct DeskServer *server, double lx, double ly,
   return NULL;
 }
 
+/* Still moving, or away from its target pose */
+bool viewAnimating(struct View *view) {
+  return fabsf(view->vel_x) >= ANIMATION_SETTLE_VELOCITY ||
+    fabsf(view->vel_y) >= ANIMATION_SETTLE_VELOCITY ||
+    fabsf(view->rot_vel) >= ANIMATION_SETTLE_ROT_VELOCITY ||
+    view->x != view->target_x || view->y != view->target_y || view->rot != view->target_rot;
+}
+
 struct point centerPoint(struct View v) {
   struct point center = {0, 0};
   if (!v.xdg || !v.xdg->surface) {
@@ -157,10 +215,12 @@ struct point centerPoint(struct View v) {
 HANDLE(map, void, View) {
   LOG("View mapped");
   wl_list_insert(&container->server->views, &container->link);
+  container->node.dirty = true;
   
   /* Focus the new view */
   focusView(container, container->xdg->surface);
   damageWholeServer(container->server);
+  wakeAnimation(container->server);
 }
 HANDLE(unmap, void, View) {
   LOG("UNMAMAMMANNNNNNN");
@@ -186,8 +246,14 @@ HANDLE(requestMove, void, View) {
 HANDLE(requestResize, void, View) {
 }
 HANDLE(requestMaximize, void, View) {
+  if (!container->xdg->initialized) return;
+  setViewState(container, container->xdg->toplevel->requested.maximized,
+               container->fullscreen);
 }
 HANDLE(requestFullscreen, void, View) {
+  if (!container->xdg->initialized) return;
+  setViewState(container, container->maximized,
+               container->xdg->toplevel->requested.fullscreen);
 }
 HANDLE(commit, struct wlr_surface, View) {
   if (!container->xdg) return;
@@ -198,8 +264,13 @@ HANDLE(commit, struct wlr_surface, View) {
 
   if (container->xdg->role == WLR_XDG_SURFACE_ROLE_TOPLEVEL &&
       container->xdg->toplevel) {
-    wlr_xdg_toplevel_set_size(container->xdg->toplevel, 0, 0);
+    struct wlr_xdg_toplevel_requested *requested = &container->xdg->toplevel->requested;
     container->needs_configure = false;
+    if (requested->maximized || requested->fullscreen) {
+      setViewState(container, requested->maximized, requested->fullscreen);
+    } else {
+      wlr_xdg_toplevel_set_size(container->xdg->toplevel, 0, 0);
+    }
     return;
   }
 
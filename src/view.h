@@ -2,6 +2,7 @@
 #include "imports.h"
 #include "server.h"
 #include "events.h"
+#include "scene.h"
 #include <time.h>
 #include <math.h>
 
@@ -23,25 +24,44 @@ typedef struct View {
   bool needs_configure;
 
   float x, y;
-  float fadeIn;
+  float fadeIn;       // 1 -> 0 over ANIMATION_FADE_IN seconds after creation
   float rot;
   float scale;
   
-  // Smooth movement with velocity
+  // Smooth movement with velocity, in pixels per second
   float vel_x, vel_y;
   float target_x, target_y;
   
-  // Smooth rotation with velocity
+  // Smooth rotation with velocity, in radians per second
   float rot_vel;
   float target_rot;
   
-  // Dampening factor (0.0-1.0, lower = smoother)
+  // Velocity kept per 16 ms of friction (0.0-1.0, lower = stiffer)
   float dampening;
+
+  // Maximized/fullscreen views cover their output; saved pose to restore
+  bool maximized, fullscreen;
+  float saved_x, saved_y, saved_rot;
+
+  // Unrotated composite of the surface tree, drawn as one quad while the
+  // view is rotated or moving. Origin is relative to the view position.
+  GLuint cacheFBO, cacheTexture;
+  int cacheX, cacheY, cacheWidth, cacheHeight;
+  pixman_region32_t cacheOpaque;
+  bool cacheDirty;
+
+  struct SceneNode node;
+  int treeSurfaces;  // surfaces in the tree at the last commit
+  int64_t lastFrameDoneNs;  // when the tree last got frame callbacks
+  bool frameThrottled;      // held back while hidden, waiting on the throttle timer
+  int64_t pendingKeyNs;     // newest key sent to the view that no commit has shown yet
 } View;
 
 struct View *mkView(struct DeskServer*, struct wlr_xdg_surface*);
 void destroyView(struct View *);
 void focusView(struct View *, struct wlr_surface *surface);
+void setViewState(struct View *, bool maximized, bool fullscreen);
+bool viewAnimating(struct View *);
 struct View *viewAt(struct DeskServer *, double lx, double ly, 
                     struct wlr_surface **surface, double *sx, double *sy);
 